@@ -1,5 +1,5 @@
-/* amiga/dosio.c -- append to a file WITHOUT going through libnix's file
- * descriptor layer.
+/* amiga/dosio.c -- append to or resize a file WITHOUT going through
+ * libnix's file descriptor layer.
  *
  * WHY THIS EXISTS (read before "simplifying" Log() back to fopen):
  *
@@ -72,3 +72,25 @@ int amiga_dos_append (const char *path, const char *data, int len)
     Close (fh);
     return 0;
 }
+
+/* Make path exactly size bytes long, creating it if absent. Used to give
+ * a received file its announced length in one go, so the filesystem can
+ * allocate it in one piece instead of a block per write, and to cut it
+ * back to what arrived. SetFileSize() is V36+ dos.library.
+ * Returns 0 on success, -1 on failure. Never touches ___stdfiledes. */
+int amiga_dos_setsize (const char *path, long size)
+{
+    BPTR fh;
+    LONG rc;
+
+    if (path == NULL || size < 0)
+        return -1;
+
+    fh = Open ((STRPTR) path, MODE_READWRITE);
+    if (fh == 0)
+        return -1;
+
+    rc = SetFileSize (fh, size, OFFSET_BEGINNING);
+    Close (fh);
+    return rc == -1 ? -1 : 0;
+}
@@ -2,4 +2,5 @@
 #ifndef AMIGA_DOSIO_H
 #define AMIGA_DOSIO_H
 int amiga_dos_append (const char *path, const char *data, int len);
+int amiga_dos_setsize (const char *path, long size);
 #endif
@@ -176,3 +176,52 @@ void *amiga_public_log_sem(void)
     cached = sem;
     return sem;
 }
+
+/* ------------------------------------------------------------------ *
+ * A public AREA: the same find-or-create as the log semaphore above, but
+ * with `size' bytes of MEMF_PUBLIC memory behind the semaphore for data
+ * that all instances share (bsy.c's shared-bsy table). The name is copied
+ * into the block itself -- the log semaphore's ln_Name points into the
+ * program that created it, which is fine only because that string never
+ * needs to outlive every instance.
+ *
+ * An area is never freed: some other instance may still be using it, and
+ * it is one allocation until reboot. A semaphore of that name that was
+ * not made here, or was made for a different size (an older binary),
+ * gets NULL, and the caller goes on without it.
+ * ------------------------------------------------------------------ */
+struct amiga_area
+{
+    struct SignalSemaphore sem;          /* first: LockSem() takes the area */
+    unsigned long size;
+    char name[32];
+};
+
+void *amiga_public_area(char *name, unsigned long size, void **data)
+{
+    struct amiga_area *a;
+
+    Forbid();
+    a = (struct amiga_area *) FindSemaphore ((STRPTR) name);
+    if (a == NULL)
+    {
+        a = (struct amiga_area *)
+            AllocMem (sizeof (struct amiga_area) + size, MEMF_PUBLIC | MEMF_CLEAR);
+        if (a != NULL)
+        {
+            InitSemaphore (&a->sem);
+            a->size = size;
+            strncpy (a->name, name, sizeof (a->name) - 1);
+            a->sem.ss_Link.ln_Name = a->name;
+            a->sem.ss_Link.ln_Pri  = 0;
+            AddSemaphore (&a->sem);
+        }
+    }
+    else if (a->sem.ss_Link.ln_Name != a->name || a->size != size)
+        a = NULL;
+    Permit();
+
+    if (a != NULL)
+        *data = a + 1;
+    return a;
+}
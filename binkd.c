@@ -33,6 +33,9 @@
 #include "tools.h"
 #include "bsy.h"
 #include "protocol.h"
+#include "inbound.h"
+#include "srif.h"
+#include "flight.h"
 #include "setpttl.h"
 #include "sem.h"
 #include "ftnnode.h"
@@ -591,7 +594,10 @@ int main (int argc, char *argv[])
       exit(0);
     }
     InitLog(current_config->loglevel, current_config->conlog,
-            current_config->logpath, current_config->nolog.first);
+            current_config->logpath, current_config->nolog.first,
+            current_config->loglevel_sub);
+    InitLogRotate(current_config->log_rotate, current_config->log_rotate_time,
+                  current_config->log_keep, current_config->log_compress);
 #ifdef AMIGA
     /* Mirror set-file-dates into the platform touch() guard - see
      * amiga/touch.c. Done here rather than inside readcfg() so it tracks
@@ -644,6 +650,9 @@ int main (int argc, char *argv[])
 #endif
 
   bsy_init ();
+  inb_init ();
+  evt_init ();
+  flight_init ();
   rnd ();
   initsetproctitle (argc, argv, environ);
 #ifdef WIN32
@@ -759,7 +768,12 @@ int main (int argc, char *argv[])
       dup2(tempfd, fileno(stdout));
       close(tempfd);
     }
-    protocol (inetd_socket_in, inetd_socket_out, NULL, pftn_addr, NULL, NULL, remote_addr, current_config);
+    {
+      FLIGHT *fr = flight_start (current_config);
+
+      protocol (inetd_socket_in, inetd_socket_out, NULL, pftn_addr, NULL, NULL, remote_addr, current_config);
+      flight_end (fr);
+    }
     soclose (inetd_socket_out);
     exit (0);
   }
@@ -3,6 +3,8 @@
  * code is working in VERY diff. ways in forking vs. threading versions!!
  */
 
+#define LOG_SUBSYS bsy       /* loglevel-bsy, see tools.h */
+
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
@@ -17,108 +19,394 @@
 #include "iphdr.h"
 #include "assert.h"
 #include "readdir.h" /* for rmdir() */
+#include "flight.h"
+#include "common.h"
+
+/*
+ * Our own locks, hashed by address. Each bucket chain is guarded by one
+ * of BSY_STRIPES semaphores (bucket & (BSY_STRIPES - 1)), so sessions
+ * for different nodes rarely meet on a lock, and none of them is ever
+ * held across file I/O: the exclusive create_sem_file() is what makes a
+ * lock ours, the table only remembers which ones we hold. Adding one
+ * used to take a single global semaphore around mkpath(), the create
+ * and the walk of a list that bsy_get_free_cell() scanned for a free
+ * cell, once per remote AKA while M_ADR was being processed.
+ */
+#define BSY_BUCKETS 64                  /* powers of 2 */
+#define BSY_STRIPES 8
 
 #if defined(HAVE_THREADS) || defined(AMIGA)
-static MUTEXSEM sem;	/* =0 initializer fails for amiga. removed. useless anyway? */
+static MUTEXSEM bsy_sem[BSY_STRIPES];	/* =0 initializer fails for amiga */
+static MUTEXSEM bsy_touch_sem;		/* guards bsy_next_due, bsy_touching,
+					   bsy_refreshing */
 #endif
 
 typedef struct _BSY_ADDR BSY_ADDR;
 struct _BSY_ADDR
 {
-  BSY_ADDR *next;
+  BSY_ADDR *next;                       /* in the bucket */
   FTN_ADDR fa;
+  FTN_KEY key;                          /* fa, packed */
   bsy_t bt;
+  time_t due;                           /* next bsy_touch() of the file */
 #if !defined(UNIX) && !defined(AMIGA)
   int h;
 #endif
 };
 
-BSY_ADDR *bsy_list = 0;
+static BSY_ADDR *bsy_table[BSY_BUCKETS];
+static time_t bsy_next_due;             /* earliest due, 0: none held */
+static int bsy_touching;
+static int bsy_refreshing;              /* bsy_refresher() is running */
+
+#define BSY_STRIPE(b) (&bsy_sem[(b) & (BSY_STRIPES - 1)])
+
+static int bsy_bucket (FTN_KEY *k)
+{
+  unsigned long h = (k->hi * 65599UL + k->lo) * 31 + k->dom;
+
+  return (int) ((h ^ (h >> 15)) & (BSY_BUCKETS - 1));
+}
+
+/*
+ * How long one of our locks may go untouched: bsy-refresh percent of
+ * kill-old-bsy, but not more often than every BSY_TOUCH_DELAY seconds.
+ * Without kill-old-bsy we cannot know the peers' age limit, so keep the
+ * old one-minute cadence.
+ */
+static int bsy_touch_interval (BINKD_CONFIG *config)
+{
+  long t = (long) config->kill_old_bsy * config->bsy_refresh / 100;
+
+  return t < BSY_TOUCH_DELAY ? BSY_TOUCH_DELAY : (int) t;
+}
 
 void bsy_init (void)
 {
-  InitSem (&sem);
+  int i;
+
+  for (i = 0; i < BSY_STRIPES; i++)
+    InitSem (&bsy_sem[i]);
+  InitSem (&bsy_touch_sem);
 }
 
 void bsy_deinit (void)
 {
-  CleanSem (&sem);
+  int i;
+
+  for (i = 0; i < BSY_STRIPES; i++)
+    CleanSem (&bsy_sem[i]);
+  CleanSem (&bsy_touch_sem);
 }
 
-static BSY_ADDR *bsy_get_free_cell (void)
+/*
+ * Unhooks our record of fa/bt, NULL if we do not hold that lock
+ */
+static BSY_ADDR *bsy_unhook (FTN_ADDR *fa, bsy_t bt)
 {
-  BSY_ADDR *lst;
+  BSY_ADDR **pp, *bsy;
+  FTN_KEY key;
+  int b;
+
+  ftnaddress_to_key (&key, fa);
+  b = bsy_bucket (&key);
+  LockSem (BSY_STRIPE (b));
+  for (pp = &bsy_table[b]; (bsy = *pp) != NULL; pp = &bsy->next)
+    if (bsy->bt == bt && !ftnaddress_keycmp (&bsy->key, &bsy->fa, &key, fa))
+    {
+      *pp = bsy->next;
+      break;
+    }
+  ReleaseSem (BSY_STRIPE (b));
+  return bsy;
+}
+
+/*
+ * Locks that are not ours -- another mailer, a tosser, a crash -- as
+ * bsy_test() last found them on disk, trusted for BSY_SEEN_TTL seconds.
+ * qn_free() tests every node's .csy at each queue rebuild and do_client()
+ * both flags per call, which with a big nodelist was thousands of
+ * access() calls per rescan for locks that hardly ever exist. Being
+ * wrong costs little either way: a lock that appeared meanwhile still
+ * makes bsy_add()'s exclusive create fail, and one that went away only
+ * delays a call. Kept in the same buckets and under the same stripes as
+ * our own; a record is updated in place and only freed at exit. With a
+ * shared-bsy table an answer is also held against the table's word for
+ * the same address: see bsy_known().
+ */
+#define BSY_SEEN_TTL 120
+
+struct bsy_seen
+{
+  struct bsy_seen *next;
+  FTN_ADDR fa;
+  FTN_KEY key;
+  bsy_t bt;
+  char busy;
+  time_t at;
+  char shared;                          /* busy: the table held it too */
+};
+
+static struct bsy_seen *bsy_seen_table[BSY_BUCKETS];
+
+#ifdef AMIGA
+/*
+ * shared-bsy: our locks are also entered in a table in public memory that
+ * every AmiBinkD instance on the machine uses (amiga_public_area(), see
+ * amiga/sem.c), so the answering and the polling instance see each
+ * other's locks at once rather than by access() and bsy_seen's
+ * two-minute memory of it. The .bsy/.csy files stay the real locks:
+ * other mailers and tossers know only those, and without the table
+ * everything works as before, just with more disk lookups.
+ *
+ * A slot is good until `until', which bsy_touch() moves on, so the slots
+ * of an instance that crashed run out by themselves. A lock the table
+ * does not hold is not looked for on disk (bsy_test()): a file of
+ * another mailer or a tosser still makes bsy_add()'s exclusive create
+ * fail, which is where it matters.
+ *
+ * The name carries the layout: instances of different builds must not
+ * share one.
+ */
+#define BSY_SHARED_NAME  "AmiBinkD.bsy.2"
+#define BSY_SHARED_SLOTS 256
+
+struct bsy_shared_slot
+{
+  void *owner;                          /* &bsy_table of the instance, NULL: free */
+  time_t until;
+  int z, net, node, p;
+  bsy_t bt;
+  char domain[MAX_DOMAIN + 1];
+};
+
+struct bsy_shared
+{
+  struct bsy_shared_slot slot[BSY_SHARED_SLOTS];
+};
 
-  for (lst = bsy_list; lst; lst = lst->next)
-    if (FA_ISNULL (&lst->fa))
+static void *bsy_shared_sem;
+static struct bsy_shared *bsy_shared_tab;
+static int bsy_shared_tried;
+
+static struct bsy_shared *bsy_shared_get (BINKD_CONFIG *config)
+{
+  void *data;
+
+  if (!config->shared_bsy)
+    return NULL;
+  if (!bsy_shared_tried)                /* a race here finds the same area */
+  {
+    if ((bsy_shared_sem = amiga_public_area (BSY_SHARED_NAME,
+                            sizeof (struct bsy_shared), &data)) != NULL)
+      bsy_shared_tab = data;
+    else
+      Log (2, "shared-bsy: no shared table, using the lock files only");
+    bsy_shared_tried = 1;
+  }
+  return bsy_shared_tab;
+}
+
+static int bsy_shared_match (struct bsy_shared_slot *sl, FTN_ADDR *fa, bsy_t bt)
+{
+  return sl->owner && sl->bt == bt && sl->z == fa->z && sl->net == fa->net &&
+         sl->node == fa->node && sl->p == fa->p && !STRICMP (sl->domain, fa->domain);
+}
+
+/*
+ * How long a slot stays good without bsy_touch(): two touch intervals
+ * plus the longest the manager loops may sleep between calls.
+ */
+static time_t bsy_shared_until (BINKD_CONFIG *config)
+{
+  return time (0) + 2 * bsy_touch_interval (config) +
+         config->rescan_delay + config->call_delay;
+}
+
+/*
+ * Enters or refreshes our slot for fa/bt; until == 0 releases it.
+ */
+static void bsy_shared_set (FTN_ADDR *fa, bsy_t bt, time_t until, BINKD_CONFIG *config)
+{
+  struct bsy_shared *sh = bsy_shared_get (config);
+  struct bsy_shared_slot *sl, *spare = NULL;
+  time_t now = time (0);
+  int i;
+
+  if (sh == NULL)
+    return;
+  LockSem (bsy_shared_sem);
+  for (i = 0; i < BSY_SHARED_SLOTS; i++)
+  {
+    sl = sh->slot + i;
+    if (sl->owner == (void *) bsy_table && bsy_shared_match (sl, fa, bt))
       break;
-  if (!lst)
+    if (spare == NULL && (sl->owner == NULL || sl->until < now))
+      spare = sl;
+  }
+  if (i < BSY_SHARED_SLOTS)
   {
-    lst = xalloc (sizeof (BSY_ADDR));
-    FA_ZERO (&lst->fa);
-    lst->next = bsy_list;
-    bsy_list = lst;
+    if (until)
+      sl->until = until;
+    else
+      sl->owner = NULL;
   }
-  return lst;
+  else if (until && spare)              /* full: the lock file still works */
+  {
+    spare->owner = (void *) bsy_table;
+    spare->until = until;
+    spare->z = fa->z;
+    spare->net = fa->net;
+    spare->node = fa->node;
+    spare->p = fa->p;
+    spare->bt = bt;
+    strnzcpy (spare->domain, fa->domain, sizeof (spare->domain));
+  }
+  ReleaseSem (bsy_shared_sem);
 }
 
+/*
+ * 1 -- another instance holds fa/bt, 0 -- not in the table, -1 -- no table
+ */
+static int bsy_shared_busy (FTN_ADDR *fa, bsy_t bt, BINKD_CONFIG *config)
+{
+  struct bsy_shared *sh = bsy_shared_get (config);
+  time_t now = time (0);
+  int i, busy = 0;
+
+  if (sh == NULL)
+    return -1;
+  LockSem (bsy_shared_sem);
+  for (i = 0; i < BSY_SHARED_SLOTS && !busy; i++)
+    if (bsy_shared_match (sh->slot + i, fa, bt) && sh->slot[i].until >= now)
+      busy = 1;
+  ReleaseSem (bsy_shared_sem);
+  return busy;
+}
 
-#ifdef DIAG_BSY
 /*
- * TEMPORARY (2026-08-15) -- pinpoints where a stalled session dies, then goes.
- *
- * A poll froze for 2h38m on 2026-08-15 with its last log line being the M_ADR
- * handler's address list. The socket sat CLOSE-WAIT with 5,550 bytes unread for
- * 49 minutes, and DIAG_SPIN never fired -- so the protocol main loop was not
- * running at all and the task was blocked inside address processing, which is
- * exactly where bsy_add() runs once per remote AKA.
- *
- * Two candidates inside bsy_add(), and these markers tell them apart:
- *   want-lock -> (silence)  = blocked on the GLOBAL bsy semaphore, i.e. some
- *                             sibling Process is holding it across file I/O.
- *                             Same shape as the bsy_touch() ratchet.
- *   creating  -> (silence)  = blocked in create_sem_file()'s open(), i.e. a
- *                             single object the emulator will not let go.
- * Whichever line is last names the failure.
+ * Releases all our slots, for bsy_remove_all()
  */
-#define DIAG_BSY_LOG(...) Log (4, __VA_ARGS__)
+static void bsy_shared_drop (void)
+{
+  int i;
+
+  if (bsy_shared_tab == NULL)
+    return;
+  LockSem (bsy_shared_sem);
+  for (i = 0; i < BSY_SHARED_SLOTS; i++)
+    if (bsy_shared_tab->slot[i].owner == (void *) bsy_table)
+      bsy_shared_tab->slot[i].owner = NULL;
+  ReleaseSem (bsy_shared_sem);
+}
 #else
-#define DIAG_BSY_LOG(...) do { } while (0)
+/* Elsewhere the lock files are all there is. */
+#define bsy_shared_set(fa, bt, until, config)
+#define bsy_shared_busy(fa, bt, config) (-1)
+#define bsy_shared_drop()
 #endif
 
-int bsy_add (FTN_ADDR *fa0, bsy_t bt, BINKD_CONFIG *config)
+/*
+ * 1 -- busy, 0 -- free, -1 -- have to look. Call with the stripe locked.
+ * Per address, so nothing another node's lock does throws the record
+ * away: a "free" stands while the table does not hold fa/bt, a "busy"
+ * that the table held while the table still does, and one that was only
+ * a file for BSY_SEEN_TTL.
+ */
+static int bsy_known (FTN_ADDR *fa, FTN_KEY *key, int b, bsy_t bt, time_t now,
+                      BINKD_CONFIG *config)
 {
-  char buf[MAXPATHLEN + 1];
-  int ok = 0;
+  BSY_ADDR *bsy;
+  struct bsy_seen *seen;
 
-  ftnaddress_to_filename (buf, fa0, config);
+  for (bsy = bsy_table[b]; bsy; bsy = bsy->next)
+    if (bsy->bt == bt && !ftnaddress_keycmp (&bsy->key, &bsy->fa, key, fa))
+      return 1;                         /* ours: no need to ask the disk */
+  for (seen = bsy_seen_table[b]; seen; seen = seen->next)
+    if (seen->bt == bt && !ftnaddress_keycmp (&seen->key, &seen->fa, key, fa))
+    {
+      if (now - seen->at >= BSY_SEEN_TTL || now < seen->at)
+        return -1;
+      if (!seen->busy)
+        return bsy_shared_busy (fa, bt, config) == 1;
+      if (seen->shared)
+        return bsy_shared_busy (fa, bt, config) == 1 ? 1 : -1;
+      return 1;
+    }
+  return -1;
+}
 
-  DIAG_BSY_LOG ("DIAG-BSY: add want-lock %s `%s'", bt == F_CSY ? "csy" : "bsy", buf);
-  LockSem (&sem);
-  DIAG_BSY_LOG ("DIAG-BSY: add got-lock");
-  if (*buf)
+/*
+ * Records what a look found; shared -- the table held fa/bt as well
+ */
+static void bsy_seen_set (FTN_ADDR *fa, bsy_t bt, int busy, int shared)
+{
+  struct bsy_seen *seen;
+  FTN_KEY key;
+  int b;
+
+  ftnaddress_to_key (&key, fa);
+  b = bsy_bucket (&key);
+  LockSem (BSY_STRIPE (b));
+  for (seen = bsy_seen_table[b]; seen; seen = seen->next)
+    if (seen->bt == bt && !ftnaddress_keycmp (&seen->key, &seen->fa, &key, fa))
+      break;
+  if (seen == NULL)
   {
-    strnzcat (buf, bt == F_CSY ? ".csy" : ".bsy", sizeof (buf));
-    DIAG_BSY_LOG ("DIAG-BSY: add mkpath `%s'", buf);
-    if (mkpath (buf) == -1)
-      Log (1, "mkpath('%s'): %s", buf, strerror (errno));
+    seen = xalloc (sizeof (*seen));
+    memcpy (&seen->fa, fa, sizeof (FTN_ADDR));
+    memcpy (&seen->key, &key, sizeof (FTN_KEY));
+    seen->bt = bt;
+    seen->next = bsy_seen_table[b];
+    bsy_seen_table[b] = seen;
+  }
+  seen->busy = (char) (busy != 0);
+  seen->at = time (0);
+  seen->shared = (char) (shared != 0);
+  ReleaseSem (BSY_STRIPE (b));
+}
 
-    DIAG_BSY_LOG ("DIAG-BSY: add creating `%s'", buf);
-    if (create_sem_file (buf, 5))
-    {
-      BSY_ADDR *new_bsy = bsy_get_free_cell ();
 
-      memcpy (&new_bsy->fa, fa0, sizeof (FTN_ADDR));
+int bsy_add (FTN_ADDR *fa0, bsy_t bt, BINKD_CONFIG *config)
+{
+  char buf[MAXPATHLEN + 1];
+  BSY_ADDR *new_bsy;
+  FLIGHT *fr = flight_self ();
+  int b;
 
-      new_bsy->bt = bt;
+  ftnaddress_to_filename (buf, fa0, config);
+  if (!*buf)
+    return 0;
+
+  strnzcat (buf, bt == F_CSY ? ".csy" : ".bsy", sizeof (buf));
+  FR (fr, FR_BSY_ADD, bt, 0);
+  /* a sibling may be making the same directory right now */
+  if (mkpath (buf) == -1 && errno != EEXIST)
+    Log (1, "mkpath('%s'): %s", buf, strerror (errno));
+
+  FR (fr, FR_BSY_ADD, bt, 1);
+  /* Our own old lock still waiting in delete_pending() is busy until it
+   * is really gone; creating it anew meanwhile would let the retry
+   * remove the new one. */
+  if (delete_queued (buf) || !create_sem_file (buf, 5))
+  {
+    bsy_seen_set (fa0, bt, 1, bsy_shared_busy (fa0, bt, config) == 1);
+    FR (fr, FR_BSY_ADDED, 0, 0);
+    return 0;
+  }
+
+  new_bsy = xalloc (sizeof (BSY_ADDR));
+  memcpy (&new_bsy->fa, fa0, sizeof (FTN_ADDR));
+  ftnaddress_to_key (&new_bsy->key, &new_bsy->fa);
+  new_bsy->bt = bt;
 
 /* AmigaOS is grouped with UNIX for the .bsy/.csy handle below.
  *
  * Every other non-UNIX platform keeps the lock file open (BSY_ADDR.h) and
  * relies on that handle to stop anyone else deleting it. That cannot work
  * here. AmigaOS file handles are per-Process, exactly like sockets, and
- * since v10.5 each session is its own Process while bsy_list is a plain
- * global shared by all of them (classic AmigaOS has one flat address
+ * since v10.5 each session is its own Process while the lock table is a
+ * plain global shared by all of them (classic AmigaOS has one flat address
  * space -- no fork() copy-on-write). So a Process closing bsy->h for a
  * cell some *other* Process created closes an unrelated descriptor in its
  * own table; the real handle stays open, and AmigaOS will not delete an
@@ -134,24 +422,32 @@ int bsy_add (FTN_ADDR *fa0, bsy_t bt, BINKD_CONFIG *config)
  * IS the lock. That reasoning holds identically on AmigaOS, so take the
  * same path rather than inventing a per-Process handle table. */
 #if !defined(UNIX) && !defined(AMIGA)
-      new_bsy->h = open(buf, O_RDONLY|O_NOINHERIT);
-      if (new_bsy->h == -1)
-        Log (2, "Can't open %s: %s!", buf, strerror(errno));
+  new_bsy->h = open(buf, O_RDONLY|O_NOINHERIT);
+  if (new_bsy->h == -1)
+    Log (2, "Can't open %s: %s!", buf, strerror(errno));
 #if defined(OS2)
-      else
-        DosSetFHState(new_bsy->h, OPEN_FLAGS_NOINHERIT);
+  else
+    DosSetFHState(new_bsy->h, OPEN_FLAGS_NOINHERIT);
 #elif defined(EMX)
-      else
-        fcntl(new_bsy->h,  F_SETFD, FD_CLOEXEC);
+  else
+    fcntl(new_bsy->h,  F_SETFD, FD_CLOEXEC);
 #endif
 #endif
 
-      ok = 1;
-    }
-  }
-  DIAG_BSY_LOG ("DIAG-BSY: add done, releasing lock");
-  ReleaseSem (&sem);
-  return ok;
+  b = bsy_bucket (&new_bsy->key);
+  FR (fr, FR_BSY_ADD, bt, 2);
+  LockSem (BSY_STRIPE (b));
+  new_bsy->due = time (0) + bsy_touch_interval (config);
+  bsy_shared_set (fa0, bt, bsy_shared_until (config), config);
+  new_bsy->next = bsy_table[b];
+  bsy_table[b] = new_bsy;
+  ReleaseSem (BSY_STRIPE (b));
+  LockSem (&bsy_touch_sem);
+  if (bsy_next_due == 0 || new_bsy->due < bsy_next_due)
+    bsy_next_due = new_bsy->due;
+  ReleaseSem (&bsy_touch_sem);
+  FR (fr, FR_BSY_ADDED, 1, 0);
+  return 1;
 }
 
 /*
@@ -160,19 +456,29 @@ int bsy_add (FTN_ADDR *fa0, bsy_t bt, BINKD_CONFIG *config)
 int bsy_test (FTN_ADDR *fa0, bsy_t bt, BINKD_CONFIG *config)
 {
   char buf[MAXPATHLEN + 1];
+  FTN_KEY key;
+  int b, busy;
+
+  ftnaddress_to_key (&key, fa0);
+  b = bsy_bucket (&key);
+  LockSem (BSY_STRIPE (b));
+  busy = bsy_known (fa0, &key, b, bt, time (0), config);
+  ReleaseSem (BSY_STRIPE (b));
+  if (busy != -1)
+    return !busy;
+  /* The table answers for every AmiBinkD on the machine; see bsy_shared */
+  if ((busy = bsy_shared_busy (fa0, bt, config)) != -1)
+    return !busy;
 
   ftnaddress_to_filename (buf, fa0, config);
-  if (*buf)
-  {
-    strnzcat (buf, bt == F_CSY ? ".csy" : ".bsy", sizeof (buf));
-
-    if (mkpath (buf) == -1)
-      Log (1, "mkpath('%s'): %s", buf, strerror (errno));
-
-    if (access (buf, F_OK) == -1)
-      return 1;
-  }
-  return 0;
+  if (!*buf)
+    return 0;
+  strnzcat (buf, bt == F_CSY ? ".csy" : ".bsy", sizeof (buf));
+  /* No mkpath() here: a missing directory holds no lock, and bsy_add()
+   * makes it when it is really needed. */
+  busy = access (buf, F_OK) != -1;
+  bsy_seen_set (fa0, bt, busy, 0);
+  return !busy;
 }
 
 /*
@@ -197,6 +503,12 @@ int bsy_test (FTN_ADDR *fa0, bsy_t bt, BINKD_CONFIG *config)
  * a few ms defeated them, while a few tens of milliseconds of delay was
  * enough. 10 tries x 40ms is 400ms worst case instead of 4s, with more
  * attempts than before rather than fewer.
+ *
+ * A lock still held after those is handed to delete_defer() (tools.c) and
+ * retried from the manager loops with backoff instead of stalling the
+ * session further. The lock is already out of bsy_table, and bsy_add()
+ * refuses the address while the old file is queued. Returns 0 when the
+ * file is gone, 1 when it is queued, -1 on a hard error.
  */
 #define BSY_UNLINK_TRIES 10
 
@@ -218,6 +530,8 @@ static int bsy_unlink (char *path)
     if (!(errno == EPERM || errno == EACCES || errno == EAGAIN || errno == ETXTBSY))
       break;
   }
+  if (i == BSY_UNLINK_TRIES && delete_defer (path) == 0)
+    return 1;                           /* still there, but not for long */
 
   /* v10.28: quieten a race that is not a fault.
    *
@@ -247,7 +561,15 @@ static int bsy_unlink (char *path)
 
   Log (5, "could not remove own lock `%s': %s", path, strerror (errno));
 #else
-  rc = sdelete (path);
+  if ((rc = UNLINK (path)) == 0)
+    Log (6, "unlinked `%s'", path);
+  else if (errno == ENOENT)
+    rc = 0;
+  else if ((errno == EPERM || errno == EACCES || errno == EAGAIN || errno == ETXTBSY) &&
+           delete_defer (path) == 0)
+    rc = 1;
+  else
+    Log (1, "error unlinking `%s': %s", path, strerror (errno));
 #endif
   return rc;
 }
@@ -258,45 +580,39 @@ void bsy_remove (FTN_ADDR *fa0, bsy_t bt, BINKD_CONFIG *config)
   BSY_ADDR *bsy;
 
   ftnaddress_to_filename (buf, fa0, config);
-  if (*buf)
-  {
-    strnzcat (buf, bt == F_CSY ? ".csy" : ".bsy", sizeof (buf));
+  if (!*buf)
+    return;
+  strnzcat (buf, bt == F_CSY ? ".csy" : ".bsy", sizeof (buf));
 
-    DIAG_BSY_LOG ("DIAG-BSY: remove want-lock `%s'", buf);
-    LockSem (&sem);
-    DIAG_BSY_LOG ("DIAG-BSY: remove got-lock");
-    for (bsy = bsy_list; bsy; bsy = bsy->next)
-    {
-      if (!ftnaddress_cmp (&bsy->fa, fa0) && bsy->bt == bt)
-      {
+  FR_SELF (FR_BSY_REMOVE, bt, 0);
+  /* Once unhooked nobody else can find it, and nobody can create the
+   * file again until it is gone, so the unlink needs no lock at all. */
+  if ((bsy = bsy_unhook (fa0, bt)) == NULL)
+    return;
 #if !defined(UNIX) && !defined(AMIGA)
-	if (bsy->h != -1)
-	  if (close(bsy->h))
-            Log (2, "Can't close %s (handle %d): %s!", buf, bsy->h, strerror(errno));
+  if (bsy->h != -1)
+    if (close(bsy->h))
+      Log (2, "Can't close %s (handle %d): %s!", buf, bsy->h, strerror(errno));
 #endif
-	bsy_unlink (buf);
-	/* remove empty point directory */
-	if (config->deletedirs)
-	{
-	  FTN_DOMAIN *d;
-	  if (fa0->p != 0 && (p = last_slash(buf)) != NULL)
-	  {
-	    *p = '\0';
-	    rmdir(buf);
-	  }
-	  /* remove empty zone directory */
-	  d = get_domain_info (fa0->domain, config->pDomains.first);
-	  if (d && (fa0->z != d->z[0]) && (p = last_slash(buf)) != NULL)
-	  {
-	    *p = '\0';
-	    rmdir(buf);
-	  }
-	}
-	FA_ZERO (&bsy->fa);
-	break;
-      }
+  free (bsy);
+  bsy_seen_set (fa0, bt, bsy_unlink (buf) != 0, 0);
+  bsy_shared_set (fa0, bt, 0, config);  /* after the file: see bsy_shared */
+  /* remove empty point directory */
+  if (config->deletedirs)
+  {
+    FTN_DOMAIN *d;
+    if (fa0->p != 0 && (p = last_slash(buf)) != NULL)
+    {
+      *p = '\0';
+      rmdir(buf);
+    }
+    /* remove empty zone directory */
+    d = get_domain_info (fa0->domain, config->pDomains.first);
+    if (d && (fa0->z != d->z[0]) && (p = last_slash(buf)) != NULL)
+    {
+      *p = '\0';
+      rmdir(buf);
     }
-    ReleaseSem (&sem);
   }
 }
 
@@ -307,145 +623,149 @@ void bsy_remove_all (BINKD_CONFIG *config)
 {
   char buf[MAXPATHLEN + 1], *p;
   BSY_ADDR *bsy;
+  int b;
 
-  for (bsy = bsy_list; bsy; bsy = bsy->next)
+  for (b = 0; b < BSY_BUCKETS; b++)
   {
-    if (FA_ISNULL (&bsy->fa)) continue; /* free cell */
-    ftnaddress_to_filename (buf, &bsy->fa, config);
-    if (*buf)
+    while ((bsy = bsy_table[b]) != NULL)
     {
-      strnzcat (buf, bsy->bt == F_CSY ? ".csy" : ".bsy", sizeof (buf));
+      bsy_table[b] = bsy->next;
+      ftnaddress_to_filename (buf, &bsy->fa, config);
+      if (*buf)
+      {
+        strnzcat (buf, bsy->bt == F_CSY ? ".csy" : ".bsy", sizeof (buf));
 #if !defined(UNIX) && !defined(AMIGA)
-      if (bsy->h != -1)
-        if (close(bsy->h))
-          Log (2, "Can't close %s (handle %d): %s!", buf, bsy->h, strerror(errno));
+        if (bsy->h != -1)
+          if (close(bsy->h))
+            Log (2, "Can't close %s (handle %d): %s!", buf, bsy->h, strerror(errno));
 #endif
-      bsy_unlink (buf);
-      /* remove empty point directory */
-      if (config->deletedirs && bsy->fa.p != 0 && (p = last_slash(buf)) != NULL)
-      {
-	*p = '\0';
-	rmdir(buf);
+        bsy_unlink (buf);
+        /* remove empty point directory */
+        if (config->deletedirs && bsy->fa.p != 0 && (p = last_slash(buf)) != NULL)
+        {
+          *p = '\0';
+          rmdir(buf);
+        }
       }
+      free (bsy);
+    }
+    while (bsy_seen_table[b] != NULL)
+    {
+      struct bsy_seen *seen = bsy_seen_table[b];
 
-      FA_ZERO (&bsy->fa);
+      bsy_seen_table[b] = seen->next;
+      free (seen);
     }
   }
+  bsy_next_due = 0;
+  bsy_shared_drop ();
   Log (6, "bsy_remove_all: done");
   bsy_deinit ();
 }
 
 /*
- * Touchs all our .bsy's if needed
+ * Touches those of our .bsy's that are due.
+ *
+ * This used to be one pass over every lock, every BSY_TOUCH_DELAY
+ * seconds, run from the protocol main loop of whichever session got
+ * there first. That put a burst of file date I/O -- the touch() that can
+ * block for hours on AmigaOS (see readcfg.c) -- into a session, and
+ * needed the double-checked, never-wait claim that lived here to keep
+ * siblings from stranding behind it.
+ *
+ * Now each lock carries its own due time, bsy-refresh percent of
+ * kill-old-bsy after it was made or last touched, and this runs in a
+ * refresher of its own that the manager loops start when something is
+ * due (bsy_refresh() below). bsy_next_due makes the common call a single
+ * compare. A stripe that is busy is skipped and retried on the next
+ * call; no lock is held across a touch().
+ */
+
+/*
+ * Unlocked peek: is any of our locks due? Rechecked under bsy_touch_sem.
  */
+static int bsy_due (time_t now, BINKD_CONFIG *config)
+{
+  if (bsy_next_due == 0 || now < bsy_next_due)
+    return 0;
+  /* Nothing to do at all if datestamping is off (see readcfg.c for why
+   * AmigaOS defaults set-file-dates off) and there are no shared-bsy
+   * slots to keep alive. */
+  return config->set_file_dates || config->shared_bsy;
+}
+
 void bsy_touch (BINKD_CONFIG *config)
 {
-  static time_t last_touch = 0;
-  BSY_ADDR *cur;
+  FTN_ADDR *fa = NULL;
+  bsy_t *bt = NULL;
+  time_t now = time (0), next = 0;
+  int b, n = 0, nalloc = 0, i, interval;
 
-  /* Cheap check BEFORE taking the lock.
-   *
-   * Every session calls this on every pass of the protocol main loop, so
-   * with N concurrent sessions it was N global-semaphore acquisitions per
-   * pass purely to discover there is nothing to do yet -- the timer test
-   * used to live inside the critical section. On AmigaOS that contention
-   * was enough to strand sessions here: instrumentation on 2026-08-07
-   * recorded 251 entries to bsy_touch() against 152 exits, i.e. 99
-   * sessions went in and never came out, while SELECT() immediately
-   * before it balanced perfectly (250 in / 251 out).
-   *
-   * It is self-amplifying, which matches the observed curve: stranded
-   * sessions keep their .bsy entries, so bsy_list grows, so each pass
-   * holds the lock longer, so more sessions strand. Skipping the lock
-   * entirely on the ~99.9% of calls that have no work removes it.
-   *
-   * Safe as double-checked locking: last_touch is only advanced under the
-   * lock, and the worst case of a stale read is touching the files one
-   * pass early or late, which BSY_TOUCH_DELAY already tolerates. */
-  if (time (0) - last_touch <= BSY_TOUCH_DELAY)
+  if (!bsy_due (now, config))
     return;
 
-  /* Nothing to do at all if datestamping is off: every useful thing this
-   * function does is a touch(). Bail before walking the list rather than
-   * spinning the lock for a no-op. See readcfg.c for why AmigaOS defaults
-   * set-file-dates off -- touch() there can block forever, and this
-   * function runs on every pass of every session's protocol main loop,
-   * which made it the single most exposed caller in the program. */
-  if (!config->set_file_dates)
+  LockSem (&bsy_touch_sem);
+  if (bsy_touching || bsy_next_due == 0 || now < bsy_next_due)
   {
-    last_touch = time (0);
+    ReleaseSem (&bsy_touch_sem);
     return;
   }
+  bsy_touching = 1;
+  bsy_next_due = 0;
+  ReleaseSem (&bsy_touch_sem);
 
-  /* The double-checked lock above was not enough on its own (measured
-   * again 2026-08-08: 236 entries to 136 exits, 100 sessions stranded
-   * here, while the SELECT() immediately before balanced 236/235). Cutting
-   * the *number* of acquisitions does nothing about the shape of the bug:
-   * this is a single global semaphore held across filesystem I/O, so one
-   * session that blocks inside touch() -- or inside the Log() next to it,
-   * on a filesystem that routinely returns ETXTBSY here -- pins the
-   * semaphore, and every sibling then blocks forever in ObtainSemaphore()
-   * on the next pass of its protocol main loop. One stuck file operation
-   * takes down every concurrent session, which is exactly the observed
-   * ratchet: n_servers climbs monotonically until it hits max_servers and
-   * all inbound is refused.
-   *
-   * Two changes, either of which alone would break that chain:
-   *
-   *   1. Never block acquiring this lock. Touching .bsy files is periodic
-   *      cosmetic maintenance (it stops peers ageing our locks out); a
-   *      skipped pass costs nothing, and BSY_TOUCH_DELAY already tolerates
-   *      being early or late. AttemptSemaphore() over ObtainSemaphore().
-   *
-   *   2. Do not hold the lock across the I/O at all. Claim the pass, copy
-   *      out what is needed, release, and touch the files unlocked.
-   *
-   * With both, a session that hangs in touch() strands only itself and
-   * leaves the semaphore free, instead of taking every sibling with it. */
-  if (!TryLockSem (&sem))
-    return;
+  interval = bsy_touch_interval (config);
+  for (b = 0; b < BSY_BUCKETS; b++)
+  {
+    BSY_ADDR *cur;
 
-  if (time (0) - last_touch <= BSY_TOUCH_DELAY)
-  {                                     /* someone else claimed this pass */
-    ReleaseSem (&sem);
-    return;
+    if (bsy_table[b] == NULL)
+      continue;
+    if (!TryLockSem (BSY_STRIPE (b)))
+    {
+      next = now;                       /* look again next time */
+      continue;
+    }
+    for (cur = bsy_table[b]; cur; cur = cur->next)
+    {
+      if (cur->due <= now)
+      {
+        if (n >= nalloc)
+        {
+          nalloc = nalloc ? nalloc * 2 : 8;
+          fa = xrealloc (fa, nalloc * sizeof (FTN_ADDR));
+          bt = xrealloc (bt, nalloc * sizeof (bsy_t));
+        }
+        memcpy (fa + n, &cur->fa, sizeof (FTN_ADDR));
+        bt[n++] = cur->bt;
+        cur->due = now + interval;
+      }
+      if (next == 0 || cur->due < next)
+        next = cur->due;
+    }
+    ReleaseSem (BSY_STRIPE (b));
   }
 
-  /* Claim the pass before any I/O, so siblings take the cheap early-out at
-   * the top of this function rather than queueing up behind us. */
-  last_touch = time (0);
-  cur = bsy_list;
-  ReleaseSem (&sem);
-
-  /* Walk unlocked. Cells are never freed -- bsy_get_free_cell() reuses
-   * FA_ZERO'd ones -- so `cur' stays valid across the unlocked window, and
-   * bsy_add() only ever prepends, so it cannot splice anything into the
-   * part of the list still ahead of us. A cell that a concurrent
-   * bsy_remove() clears while we are walking just gets skipped. */
-  for (; cur; cur = cur->next)
+  LockSem (&bsy_touch_sem);
+  if (next && (bsy_next_due == 0 || next < bsy_next_due))
+    bsy_next_due = next;
+  bsy_touching = 0;
+  ReleaseSem (&bsy_touch_sem);
+
+  for (i = 0; i < n; i++)
   {
     char buf[MAXPATHLEN + 1];
-    FTN_ADDR fa;
-    bsy_t bt;
 
-    if (!TryLockSem (&sem))
-      return;                   /* contended: drop the rest of this pass */
-    if (FA_ISNULL (&cur->fa))
-    {
-      ReleaseSem (&sem);
+    bsy_shared_set (fa + i, bt[i], bsy_shared_until (config), config);
+    if (!config->set_file_dates)
       continue;
-    }
-    memcpy (&fa, &cur->fa, sizeof (fa));
-    bt = cur->bt;
-    ReleaseSem (&sem);
-
-    ftnaddress_to_filename (buf, &fa, config);
+    ftnaddress_to_filename (buf, fa + i, config);
     if (*buf)
     {
-      strnzcat (buf, bt == F_CSY ? ".csy" : ".bsy", sizeof (buf));
+      strnzcat (buf, bt[i] == F_CSY ? ".csy" : ".bsy", sizeof (buf));
       if (touch (buf, time (0)) != -1)
         Log (6, "touched %s", buf);
-      /* Touching unlocked means a concurrent bsy_remove() can sdelete()
+      /* Touching unlocked means a concurrent bsy_remove() can delete
        * this file between the copy above and the touch. That race is
        * benign and expected -- the lock is gone precisely so it can be --
        * so don't report it at the level real touch failures use. */
@@ -455,4 +775,62 @@ void bsy_touch (BINKD_CONFIG *config)
         Log (1, "touch %s: %s", buf, strerror (errno));
     }
   }
+  xfree (fa);
+  xfree (bt);
+}
+
+#if defined(HAVE_THREADS) || defined(AMIGA)
+/*
+ * The refresher: one touch pass, then gone. A touch() that never returns
+ * wedges this thread (Process on AmigaOS) alone; bsy_refreshing stays
+ * set, so no second one piles up behind it and the managers go on until
+ * shutdown. exitfunc() on AmigaOS then waits for it with no time limit
+ * (the code it runs must outlive it) and names it while it does.
+ */
+static void bsy_refresher (void *arg)
+{
+  BINKD_CONFIG *config = *(BINKD_CONFIG **) arg;
+
+  bsy_touch (config);
+  unlock_config_structure (config, 0);
+  free (arg);
+  LockSem (&bsy_touch_sem);
+  bsy_refreshing = 0;
+  ReleaseSem (&bsy_touch_sem);
+  PostSem (&eothread);
 }
+
+void bsy_refresh (BINKD_CONFIG *config)
+{
+  if (binkd_exit || !bsy_due (time (0), config))
+    return;
+  LockSem (&bsy_touch_sem);
+  if (bsy_refreshing)
+  {
+    ReleaseSem (&bsy_touch_sem);
+    return;
+  }
+  bsy_refreshing = 1;
+  ReleaseSem (&bsy_touch_sem);
+
+  lock_config_structure (config);
+  if (branch (bsy_refresher, &config, sizeof (config)) < 0)
+  {
+    Log (1, "cannot start the bsy refresher");
+    unlock_config_structure (config, 0);
+    LockSem (&bsy_touch_sem);
+    bsy_refreshing = 0;
+    ReleaseSem (&bsy_touch_sem);
+  }
+}
+
+int bsy_refresh_busy (void)
+{
+  int n;
+
+  LockSem (&bsy_touch_sem);
+  n = bsy_refreshing;
+  ReleaseSem (&bsy_touch_sem);
+  return n;
+}
+#endif
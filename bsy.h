@@ -17,6 +17,8 @@ int bsy_add(FTN_ADDR *fa, bsy_t bt, BINKD_CONFIG *config);
 
 /*
  * Test a busy-flag. 1 -- free, 0 -- busy
+ * Our own flags are known; others are only looked for on disk every
+ * BSY_SEEN_TTL seconds (bsy.c).
  */
 int bsy_test(FTN_ADDR *fa, bsy_t bt, BINKD_CONFIG *config);
 
@@ -30,9 +32,23 @@ void bsy_remove(FTN_ADDR *fa, bsy_t bt, BINKD_CONFIG *config);
 void bsy_remove_all(BINKD_CONFIG *config);
 
 /*
- * Touchs all our .bsy's if needed
+ * Touches those of our .bsy's that are due (bsy-refresh). Sessions only
+ * call it where no manager shares their locks (fork builds, inetd).
  */
 void bsy_touch (BINKD_CONFIG *config);
-#define BSY_TOUCH_DELAY 60
+
+/*
+ * From the manager loops: starts a refresher thread running bsy_touch()
+ * when a lock is due and none is running yet. bsy_refresh_busy() -- is
+ * one running (for exitfunc). Fork builds just touch in place.
+ */
+#if defined(HAVE_THREADS) || defined(AMIGA)
+void bsy_refresh (BINKD_CONFIG *config);
+int bsy_refresh_busy (void);
+#else
+#define bsy_refresh(config) bsy_touch (config)
+#define bsy_refresh_busy() 0
+#endif
+#define BSY_TOUCH_DELAY 60              /* shortest interval, seconds */
 
 #endif
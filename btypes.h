@@ -54,6 +54,15 @@ struct _FTN_ADDR
   int z, net, node, p; /* -1==unknown or wildcard */
 };
 
+/* FTN_ADDR packed for compares, see ftnaddress_to_key() */
+typedef struct _FTN_KEY FTN_KEY;
+struct _FTN_KEY
+{
+  unsigned long hi;                    /* zone+1 << 16 | net+1 */
+  unsigned long lo;                    /* node+1 << 16 | point+1 */
+  unsigned short dom;                  /* interned domain, 0 = unpacked */
+};
+
 typedef struct _FTN_NODE FTN_NODE;
 struct _FTN_NODE
 {
@@ -61,6 +70,7 @@ struct _FTN_NODE
   char *hosts;			       /* "host1:port1,host2:port2,*" */
 
   FTN_ADDR fa;
+  FTN_KEY key;                         /* fa, packed */
   char pwd[MAXPWDLEN + 1];
   char *pkt_pwd, *out_pwd;
   char obox_flvr;
@@ -96,6 +106,7 @@ struct _FTNQ
   FTNQ *prev;
 
   FTN_ADDR fa;
+  FTN_KEY key;			       /* fa, packed */
   char flvr;			       /* 'I', 'i', 'C', 'c', 'D', 'd', 'O',
 				        * 'o', 'F', 'f', 'H', 'h' */
   char action;			       /* 'd'elete, 't'runcate, '\0' -- none,
@@ -110,16 +121,20 @@ struct _FTNQ
 				        * will be send when parsing its .flo
 				        * instead, now it's obsolete),
 				        * other -- a file to send. */
-  char path[MAXPATHLEN + 1];
+  char *path;			       /* lives in the entry's chunk, see
+				        * q_new_entry() in ftnq.c */
   boff_t size;
   time_t time;			       /* this field seems to be used only in
 				        * cmp_filebox_files(), when sorting
 				        * files from a filebox before sending */
 
   int sent;			       /* == 1, if the file have been sent */
+  struct q_chunk *chunk;	       /* the block this entry was carved from */
 };
 
 /* A file in transfer */
+#define PKT_HDR_SIZE 58                     /* what check_pkthdr() looks at */
+
 typedef struct _TFILE TFILE;
 struct _TFILE
 {
@@ -134,6 +149,12 @@ struct _TFILE
   time_t time;				    /* Filetime */
   FILE *f;
   FTN_ADDR fa;
+  unsigned char pkthdr[PKT_HDR_SIZE];	    /* Received .pkt: its header, */
+  int npkthdr;				    /* bytes of it so far, -1: none */
+  int pkthdr_ok;			    /* inb_pkthdr() verdict, 0: none yet */
+  int prealloc;				    /* Received .dt sized up front */
+  unsigned long crc;			    /* CRC-32 of the data received, */
+  int crc_ok;				    /* 0: not taken from offset 0 */
 };
 
 /* Files to kill _after_ session */
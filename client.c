@@ -30,6 +30,8 @@
 #include "tools.h"
 #include "protocol.h"
 #include "bsy.h"
+#include "inbound.h"
+#include "flight.h"
 #include "assert.h"
 #include "setpttl.h"
 #include "sem.h"
@@ -107,6 +109,10 @@ struct call_args
     BINKD_CONFIG *config;
 };
 
+/* queue-snapshot: 0 = not tried yet, 1 = done with, 2 = calling from a
+ * restored snapshot, rescanned once every node in it has been started */
+static int q_snapshot_state = 0;
+
 /*
  * Run one client loop. Return -1 to exit
  */
@@ -118,9 +124,15 @@ static int do_client(BINKD_CONFIG *config)
   if (!config->q_present)
   {
     q_free (SCAN_LISTED, config);
-    if (config->printq)
-      Log (-1, "scan\r");
-    q_scan (SCAN_LISTED, config);
+    if (q_snapshot_state == 0)
+      q_snapshot_state = q_snapshot_load (config) ? 2 : 1;
+    if (q_snapshot_state != 2)
+    {
+      if (config->printq)
+        Log (-1, "scan\r");
+      q_scan (SCAN_LISTED, config);
+      q_snapshot_save (config);
+    }
     config->q_present = 1;
     if (config->printq)
     {
@@ -171,6 +183,12 @@ static int do_client(BINKD_CONFIG *config)
       }
 #endif
     }
+    else if (q_snapshot_state == 2)
+    {
+      /* the calls from the snapshot are under way, now check it */
+      q_snapshot_state = 1;
+      config->q_present = 0;
+    }
     else
     {
       int need_sleep = config->rescan_delay;
@@ -184,6 +202,11 @@ static int do_client(BINKD_CONFIG *config)
             )
       {
         check_child(&n_clients);
+        delete_pending(0);
+        DrainLog();
+        bsy_refresh(config);
+        inb_sweep_partials(config);
+        flight_watch();
         if (poll_flag && n_clients <= 0)
         {
           blocksig();
@@ -213,6 +236,9 @@ static int do_client(BINKD_CONFIG *config)
     /* This sleep can be interrupted by signal, it's OK */
     unblocksig();
     check_child(&n_clients);
+    DrainLog();
+    bsy_refresh(config);
+    flight_watch();
     SLEEP (config->call_delay);
     check_child(&n_clients);
     blocksig();
@@ -317,43 +343,6 @@ void clientmgr (void *arg)
   exit (0);
 }
 
-#ifdef DIAG_TD
-/* v10.22 "diag6": breadcrumbs through SESSION TEARDOWN.
- *
- * diag5 settled where the hang is NOT.  Over a full day it recorded
- * 1442 recv() calls issued and 1442 returned, 129 send() issued and 129
- * returned -- not one socket call ever failed to return.  DIAG_SEL and
- * DIAG_SPIN stayed silent the entire time too.  So select(), spin loops,
- * bsy_add(), send() and recv() are all eliminated.
- *
- * What diag5 DID show is that sessions complete their handshake normally
- * and die afterwards.  The 2026-08-17 05:00 hang stopped dead here:
- *
- *     05:00:24  could not remove own lock `...12.316.0.0.bsy': Permission denied
- *     05:00:24  session closed, quitting...
- *               <nothing, ever -- no END, 7 stale locks left behind>
- *
- * "session closed, quitting..." is the LAST statement in protocol():
- * deinit_protocol() has already run by then.  A healthy poll then removes
- * the .csy call lock and writes END.  This one never even logged
- * bsy_remove()'s first line, so it died in the handful of calls between
- * those two points:
- *
- *     protocol() returns -> del_socket() -> soclose() -> bsy_remove(F_CSY)
- *                        -> amiga_close_private_socketbase()
- *
- * All of those are the AmigaOS no-timeout blocking class (same family as
- * the SetFileDate()/touch() problem fixed in v10.18), and none of them is
- * instrumented.  A hang produces no further output, so the last breadcrumb
- * names the blocking call.
- *
- * Volume is a few lines per session -- no budget needed, unlike DIAG_HS.
- */
-#define TD(fmt, ...) Log (2, "DIAG-TD: " fmt, ##__VA_ARGS__)
-#else
-#define TD(fmt, ...) do { } while (0)
-#endif
-
 static int call0 (FTN_NODE *node, BINKD_CONFIG *config)
 {
   int sockfd = INVALID_SOCKET;
@@ -377,6 +366,7 @@ static int call0 (FTN_NODE *node, BINKD_CONFIG *config)
   struct addrinfo *aiNewHead;
 #endif
   int aiErr;
+  FLIGHT *fr;
 
   /* setup hints for getaddrinfo */
   memset((void *)&hints, 0, sizeof(hints));
@@ -730,13 +720,13 @@ static int call0 (FTN_NODE *node, BINKD_CONFIG *config)
     return 0;
 
   protocol (sockfd, sock_out, node, NULL, host, port, dst_ip, config);
-  TD ("call0: protocol() returned, starting teardown");
+  fr = flight_self ();
   if (pid != -1)
   {
-    TD ("call0: del_socket(sock_out=%i)", (int) sock_out);
+    FR (fr, FR_SOCLOSE, sock_out, 0);
     del_socket(sock_out);
-    TD ("call0: close(sock_out)");
     close(sock_out);
+    FR (fr, FR_SOCLOSED, 0, 0);
 #ifdef HAVE_WAITPID
     if (waitpid (pid, &rc, 0) == -1)
     {
@@ -754,11 +744,10 @@ static int call0 (FTN_NODE *node, BINKD_CONFIG *config)
   }
   else
   {
-    TD ("call0: del_socket(sockfd=%i)", (int) sockfd);
+    FR (fr, FR_SOCLOSE, sockfd, 0);
     del_socket(sockfd);
-    TD ("call0: about to soclose(sockfd=%i)   <-- PRIME SUSPECT", (int) sockfd);
     soclose (sockfd);
-    TD ("call0: soclose() returned");
+    FR (fr, FR_SOCLOSED, 0, 0);
   }
   return 1;
 }
@@ -767,6 +756,7 @@ static void call (void *arg)
 {
   struct call_args *a = arg;
   char szDestAddr[FTN_ADDR_SZ + 1];
+  FLIGHT *fr;
 #if defined(WITH_PERL) && defined(HAVE_THREADS)
   void *cperl;
 #endif
@@ -774,6 +764,8 @@ static void call (void *arg)
   struct Library *privSocketBase;
 #endif
 
+  fr = flight_start (a->config);
+
 #if defined(WITH_PERL) && defined(HAVE_THREADS)
   cperl = perl_init_clone(a->config);
 #endif
@@ -797,9 +789,7 @@ static void call (void *arg)
   if (bsy_add (&a->node->fa, F_CSY, a->config))
   {
     call0 (a->node, a->config);
-    TD ("call: call0() returned, about to bsy_remove(F_CSY)");
     bsy_remove (&a->node->fa, F_CSY, a->config);
-    TD ("call: bsy_remove(F_CSY) returned");
   }
   else
   {
@@ -810,10 +800,12 @@ static void call (void *arg)
   perl_done_clone(cperl);
 #endif
 #ifdef AMIGA
-  TD ("call: about to amiga_close_private_socketbase()");
+  FR (fr, FR_SOCLOSE, -1, 0);
   amiga_close_private_socketbase (privSocketBase);
-  TD ("call: private SocketBase closed - session fully torn down");
+  FR (fr, FR_SOCLOSED, 0, 0);
 #endif
+  FR (fr, FR_END, 0, 0);
+  flight_end (fr);
   unlock_config_structure(a->config, 0);
   free (arg);
   rel_grow_handles(-6);
@@ -21,6 +21,9 @@
 #include "tools.h"
 #include "sem.h"
 #include "server.h"
+#include "protoco2.h"
+#include "srif.h"
+#include "flight.h"
 #ifdef WITH_PERL
 #include "perlhooks.h"
 #endif
@@ -88,6 +91,7 @@ void exitfunc (void)
 #endif
 
   Log(7, "exitfunc()");
+  flight_dump_all ("exit");
 
 #if defined(HAVE_THREADS)
   /* exit all threads */
@@ -96,7 +100,8 @@ void exitfunc (void)
     /* wait for threads exit */
     binkd_exit = 1;
     for (;;)
-      if (n_servers || n_clients || pidcmgr || pidsmgr)
+      if (n_servers || n_clients || pidcmgr || pidsmgr || evt_busy () ||
+          bsy_refresh_busy ())
       {
 	close_srvmgr_socket();
 	if (pidcmgr)
@@ -111,8 +116,8 @@ void exitfunc (void)
 	  timeout++;
 	  if (timeout == 4) /* 4 sec */
 	  {
-	    Log(5, "exitfunc(): warning, threads exit timeout (%i sec), n_servers %i, n_clients %i pidcmgr %i pidsmgr %i!",
-			    timeout, n_servers, n_clients, (int)pidcmgr, (int)pidsmgr);
+	    Log(5, "exitfunc(): warning, threads exit timeout (%i sec), n_servers %i, n_clients %i pidcmgr %i pidsmgr %i bsy refresher %i!",
+			    timeout, n_servers, n_clients, (int)pidcmgr, (int)pidsmgr, bsy_refresh_busy ());
 	    break;
 	  }
 	}
@@ -160,14 +165,15 @@ void exitfunc (void)
   { int waited = 0;
 
     binkd_exit = 1;
-    while (n_servers || n_clients)
+    while (n_servers || n_clients || evt_busy () || bsy_refresh_busy ())
     {
       if (WaitSem (&eothread, 1))
       {
         waited++;
         if (waited % 10 == 0)
-          Log (2, "exitfunc(): still waiting for %i session(s) to finish (%i sec) - not giving up, see v10.5 notes",
-               n_servers + n_clients, waited);
+          Log (2, "exitfunc(): still waiting for %i session(s), %i event worker(s) and %i .bsy refresher to finish (%i sec) - not giving up, see v10.5 notes",
+               n_servers + n_clients, evt_busy (), bsy_refresh_busy (),
+               waited);
       }
       else
       {
@@ -181,6 +187,7 @@ void exitfunc (void)
   config = lock_current_config();
   if (config)
     bsy_remove_all (config);
+  delete_pending (1);                  /* one last try, no waiting */
   sock_deinit ();
   nodes_deinit ();
   if (config)
@@ -197,6 +204,7 @@ void exitfunc (void)
   CleanSem (&config_sem);
   CleanSem (&hostsem);
   CleanSem (&resolvsem);
+  FlushLog ();
   CleanSem (&lsem);
   CleanSem (&blsem);
   CleanSem (&varsem);
@@ -0,0 +1,230 @@
+/*
+ *  flight.c -- per-session event ring ("flight recorder")
+ *
+ *  flight.c is a part of binkd project
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version. See COPYING.
+ */
+
+/*
+ * Every session keeps its last FR_EVENTS steps (select, recv, send,
+ * received commands, bsy locks, inb_done) in a ring that costs a time()
+ * and four stores per step. Nothing is written while things go well;
+ * the ring goes to the flight-dump file when the session fails, when
+ * the manager's watchdog sees it stuck, and on exit. The last event of
+ * a stuck session names the call it is blocked in.
+ *
+ * The watchdog and the exit dump copy a ring its session may still be
+ * writing, so an event or two at the write position can be torn. The
+ * list of rings is under frsem, which flight_end() takes, so a ring is
+ * never freed mid-copy; the copies are written after frsem is released,
+ * since every bsy_add() and bsy_remove() looks itself up under it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "sys.h"
+#include "readcfg.h"
+#include "flight.h"
+#include "tools.h"
+#include "sem.h"
+#ifdef AMIGA
+#include "amiga/dosio.h"
+#endif
+
+static const char *fr_names[FR_NEVENTS] =
+{
+  "-", "start", "init", "peername", "banner", "handshake",
+  "select", "selected", "recv", "recvd", "send", "sent", "msg",
+  "bsy_add", "bsy_added", "bsy_remove",
+  "inb_done", "inb_rename", "inb_renamed",
+  "timeout", "error", "closed", "soclose", "soclosed", "end"
+};
+
+/* one dump line: " HH:MM:SS  name  a b" */
+#define FR_LINE 64
+
+#if defined(HAVE_THREADS) || defined(AMIGA)
+static MUTEXSEM frsem;
+#endif
+static FLIGHT *fr_list;
+
+void flight_init (void)
+{
+  InitSem (&frsem);
+}
+
+FLIGHT *flight_start (BINKD_CONFIG *config)
+{
+  FLIGHT *fr = xalloc (sizeof (FLIGHT));
+
+  memset (fr, 0, sizeof (FLIGHT));
+  fr->pid = PID ();
+  strcpy (fr->who, "?");
+  fr->path = config->flight_dump;
+  fr->stall = config->nettimeout * 2;
+  FR (fr, FR_START, 0, 0);
+  LockSem (&frsem);
+  fr->next = fr_list;
+  fr_list = fr;
+  ReleaseSem (&frsem);
+  return fr;
+}
+
+void flight_end (FLIGHT *fr)
+{
+  FLIGHT **pp;
+
+  if (!fr)
+    return;
+  LockSem (&frsem);
+  for (pp = &fr_list; *pp; pp = &(*pp)->next)
+    if (*pp == fr)
+    {
+      *pp = fr->next;
+      break;
+    }
+  ReleaseSem (&frsem);
+  free (fr);
+}
+
+FLIGHT *flight_self (void)
+{
+  FLIGHT *fr;
+  int pid = PID ();
+
+  LockSem (&frsem);
+  for (fr = fr_list; fr; fr = fr->next)
+    if (fr->pid == pid)
+      break;
+  ReleaseSem (&frsem);
+  return fr;
+}
+
+void flight_name (FLIGHT *fr, const char *who)
+{
+  if (fr && who && *who)
+    strnzcpy (fr->who, who, sizeof (fr->who));
+}
+
+/*
+ * Writes one ring, its own session's or a copy. No semaphore held.
+ */
+static void fr_write (FLIGHT *fr, const char *why)
+{
+  char *buf, *p;
+  unsigned long i, first;
+  struct tm tm;
+  time_t now = time (NULL);
+
+  if (!fr->path || !*fr->path)
+    return;
+  p = buf = xalloc (FR_LINE * (FR_EVENTS + 4));
+  safe_localtime (&now, &tm);
+  p += sprintf (p, "--- %04d/%02d/%02d %02d:%02d:%02d [%d] %.60s: %.60s, %lu events\n",
+                tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                tm.tm_hour, tm.tm_min, tm.tm_sec,
+                fr->pid, fr->who, why, fr->n);
+  first = fr->n > FR_EVENTS ? fr->n - FR_EVENTS : 0;
+  for (i = first; i < fr->n; i++)
+  {
+    struct fr_event_rec *e = fr->ev + i % FR_EVENTS;
+    int id = (e->id > 0 && e->id < FR_NEVENTS) ? e->id : 0;
+
+    safe_localtime (&e->t, &tm);
+    p += sprintf (p, " %02d:%02d:%02d  %-11s %ld %ld\n",
+                  tm.tm_hour, tm.tm_min, tm.tm_sec, fr_names[id], e->a, e->b);
+  }
+#ifdef AMIGA
+  if (amiga_dos_append (fr->path, buf, (int) (p - buf)) != 0)
+    Log (1, "cannot append to %s", fr->path);
+#else
+  {
+    FILE *f;
+
+    if ((f = fopen (fr->path, "a")) == NULL)
+      Log (1, "cannot open %s: %s", fr->path, strerror (errno));
+    else
+    {
+      fwrite (buf, 1, p - buf, f);
+      fclose (f);
+    }
+  }
+#endif
+  free (buf);
+  Log (2, "%s: flight recorder written to %s", why, fr->path);
+}
+
+void flight_dump (FLIGHT *fr, const char *why)
+{
+  if (fr)
+    fr_write (fr, why);
+}
+
+/*
+ * A copy of fr to write later, chained to *copies. Under frsem.
+ */
+static void fr_copy (FLIGHT *fr, FLIGHT **copies)
+{
+  FLIGHT *c;
+
+  if (!fr->path || !*fr->path)
+    return;
+  c = xalloc (sizeof (FLIGHT));
+  memcpy (c, fr, sizeof (FLIGHT));
+  c->path = xstrdup (fr->path);        /* the session's config may go */
+  c->next = *copies;
+  *copies = c;
+}
+
+/*
+ * Writes and frees the copies, why NULL: the stall of each
+ */
+static void fr_write_copies (FLIGHT *copies, const char *why, time_t now)
+{
+  FLIGHT *c;
+  char buf[40];
+
+  while ((c = copies) != NULL)
+  {
+    copies = c->next;
+    if (why == NULL)
+      sprintf (buf, "no progress for %lds", (long) (now - c->last));
+    fr_write (c, why ? why : buf);
+    free (c->path);
+    free (c);
+  }
+}
+
+void flight_watch (void)
+{
+  FLIGHT *fr, *copies = NULL;
+  time_t now = time (NULL);
+
+  LockSem (&frsem);
+  for (fr = fr_list; fr; fr = fr->next)
+    if (fr->n != fr->dumped && fr->stall > 0 && now - fr->last > fr->stall)
+    {
+      fr->dumped = fr->n;
+      fr_copy (fr, &copies);
+    }
+  ReleaseSem (&frsem);
+  fr_write_copies (copies, NULL, now);
+}
+
+void flight_dump_all (const char *why)
+{
+  FLIGHT *fr, *copies = NULL;
+
+  LockSem (&frsem);
+  for (fr = fr_list; fr; fr = fr->next)
+    fr_copy (fr, &copies);
+  ReleaseSem (&frsem);
+  fr_write_copies (copies, why, time (NULL));
+}
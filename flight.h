@@ -0,0 +1,124 @@
+/*
+ *  flight.h -- per-session event ring ("flight recorder")
+ *
+ *  flight.h is a part of binkd project
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version. See COPYING.
+ */
+
+#ifndef _flight_h
+#define _flight_h
+
+#include <time.h>
+
+struct _BINKD_CONFIG;
+
+/* Events kept per session; older ones are overwritten */
+#define FR_EVENTS 128
+
+/* Event ids, named in flight.c's fr_names[] -- keep the two in step */
+enum fr_event
+{
+  FR_NONE,
+  FR_START,
+  FR_INIT,              /* protocol state set up */
+  FR_PEERNAME,          /* a: 0 = wants peernamesem, 1 = holds it;
+                           b: 0 = getpeername, 1 = getsockname */
+  FR_BANNER,            /* a: 0 = in, 1 = out */
+  FR_HANDSHAKE,         /* a: remote AKAs, b: state->state */
+  FR_SELECT,            /* a: timeout (s), b: 1 = want to write */
+  FR_SELECTED,          /* a: select() result, b: r | w << 1 */
+  FR_RECV,              /* a: bytes wanted */
+  FR_RECVD,             /* a: recv() result */
+  FR_SEND,              /* a: bytes to send */
+  FR_SENT,              /* a: send() result */
+  FR_MSG,               /* a: binkp command received, b: its length */
+  FR_BSY_ADD,           /* a: F_BSY/F_CSY, b: 0 = mkpath, 1 = creating,
+                           2 = table lock */
+  FR_BSY_ADDED,         /* a: 1 = locked */
+  FR_BSY_REMOVE,        /* a: F_BSY/F_CSY */
+  FR_INB_DONE,          /* a: file size */
+  FR_INB_RENAME,
+  FR_INB_RENAMED,       /* a: 1 = ok */
+  FR_TIMEOUT,           /* a: nettimeout */
+  FR_ERROR,             /* a: errno/TCPERRNO, b: 0 = send, 1 = recv */
+  FR_CLOSED,            /* a: 0 = ok, 1 = failed, b: I/O error */
+  FR_SOCLOSE,           /* a: socket, -1 = private SocketBase */
+  FR_SOCLOSED,
+  FR_END,
+  FR_NEVENTS
+};
+
+struct fr_event_rec
+{
+  time_t t;
+  int id;
+  long a, b;
+};
+
+typedef struct _FLIGHT FLIGHT;
+struct _FLIGHT
+{
+  FLIGHT *next;
+  int pid;                      /* PID() of the session that owns it */
+  char who[64];                 /* peer, for the dump header */
+  char *path;                   /* flight-dump of the session's config */
+  int stall;                    /* seconds without an event = stalled */
+  unsigned long n;              /* events recorded so far */
+  unsigned long dumped;         /* n at the last watchdog dump */
+  time_t last;                  /* time of the last event */
+  struct fr_event_rec ev[FR_EVENTS];
+};
+
+/*
+ * Records one event. Only the owning session writes its ring, so this
+ * takes no lock; fr may be NULL.
+ */
+#define FR(fr, id_, a_, b_) do { FLIGHT *fr_ = (fr); \
+    if (fr_) { struct fr_event_rec *e_ = fr_->ev + fr_->n % FR_EVENTS; \
+      e_->t = fr_->last = time (NULL); e_->id = (id_); \
+      e_->a = (long) (a_); e_->b = (long) (b_); fr_->n++; } \
+  } while (0)
+
+/* For code that has no STATE at hand (bsy.c, client.c teardown) */
+#define FR_SELF(id_, a_, b_) FR (flight_self (), id_, a_, b_)
+
+void flight_init (void);
+
+/*
+ * Gives the calling session a ring and registers it. flight_end()
+ * unregisters and frees it; both accept NULL.
+ */
+FLIGHT *flight_start (struct _BINKD_CONFIG *config);
+void flight_end (FLIGHT *fr);
+
+/*
+ * The ring of the calling session, NULL if it has none.
+ */
+FLIGHT *flight_self (void);
+
+/*
+ * Names the peer in later dumps.
+ */
+void flight_name (FLIGHT *fr, const char *who);
+
+/*
+ * Appends the ring to flight-dump (if set), oldest event first.
+ */
+void flight_dump (FLIGHT *fr, const char *why);
+
+/*
+ * Watchdog, called from the manager loops: dumps every session that
+ * recorded nothing for its stall time, once per stall.
+ */
+void flight_watch (void);
+
+/*
+ * Dumps every registered session, on exit.
+ */
+void flight_dump_all (const char *why);
+
+#endif
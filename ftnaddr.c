@@ -19,6 +19,7 @@
 #include "ftndom.h"
 #include "ftnaddr.h"
 #include "iphdr.h"
+#include "sem.h"
 
 typedef struct
 {
@@ -196,6 +197,81 @@ int ftnaddress_cmp (FTN_ADDR *a, FTN_ADDR *b)
     return a->p - b->p;
   return 0;
 }
+/*
+ * Domain names seen by ftnaddress_to_key(), id = index + 1. Only ever
+ * appended to, and an entry is complete before ndom counts it, so a
+ * lookup reads it without a lock; adding one takes varsem. The table is
+ * bounded because remote M_ADR lines can name any domain they like.
+ */
+#define MAX_KEY_DOMAINS 64
+
+static char key_domain[MAX_KEY_DOMAINS][MAX_DOMAIN + 1];
+static int key_ndom;
+
+#if defined(AMIGA)
+#define key_barrier() __asm__ __volatile__ ("" ::: "memory")
+#elif defined(__GNUC__)
+#define key_barrier() __sync_synchronize ()
+#else
+#define key_barrier()
+#endif
+
+static int key_find_domain (char *name, int from, int n)
+{
+  int i;
+
+  for (i = from; i < n; i++)
+    if (!STRICMP (key_domain[i], name))
+      return i + 1;
+  return 0;
+}
+
+static int key_add_domain (char *name, int seen)
+{
+  int id, n = key_ndom;
+
+  if ((id = key_find_domain (name, seen, n)) != 0 || n >= MAX_KEY_DOMAINS)
+    return id;
+  strnzcpy (key_domain[n], name, sizeof (key_domain[n]));
+  key_barrier ();
+  key_ndom = n + 1;
+  return n + 1;
+}
+
+void ftnaddress_to_key (FTN_KEY *k, FTN_ADDR *fa)
+{
+  int n, id;
+
+  k->hi = ((unsigned long) (fa->z + 1) & 0xffff) << 16 |
+          ((unsigned long) (fa->net + 1) & 0xffff);
+  k->lo = ((unsigned long) (fa->node + 1) & 0xffff) << 16 |
+          ((unsigned long) (fa->p + 1) & 0xffff);
+  k->dom = 0;
+  if (fa->z < -1 || fa->z > 65534 || fa->net < -1 || fa->net > 65534 ||
+      fa->node < -1 || fa->node > 65534 || fa->p < -1 || fa->p > 65534)
+    return;
+  n = key_ndom;
+  key_barrier ();
+  if ((id = key_find_domain (fa->domain, 0, n)) == 0)
+  {
+    threadsafe (id = key_add_domain (fa->domain, n));
+  }
+  k->dom = (unsigned short) id;
+}
+
+int ftnaddress_keycmp (FTN_KEY *ka, FTN_ADDR *a, FTN_KEY *kb, FTN_ADDR *b)
+{
+  if (!ka->dom || !kb->dom)
+    return ftnaddress_cmp (a, b);
+  if (ka->dom != kb->dom)               /* ids are not in name order */
+    return STRICMP (a->domain, b->domain);
+  if (ka->hi != kb->hi)
+    return ka->hi < kb->hi ? -1 : 1;
+  if (ka->lo != kb->lo)
+    return ka->lo < kb->lo ? -1 : 1;
+  return 0;
+}
+
 /*
  *  Compare address array with mask, return 0 if any element matches
  */
@@ -26,6 +26,21 @@ void exp_ftnaddress (FTN_ADDR *fa, FTN_ADDR *pAddr, int nAddr, FTN_DOMAIN *pDoma
  */
 int ftnaddress_cmp (FTN_ADDR *, FTN_ADDR *);
 
+/*
+ *  Packs fa into k: the domain interned to a small id, zone, net, node
+ *  and point biased by one into 16 bits each. Taken once where an
+ *  address is stored (nodes, queue entries, busy flags), it turns every
+ *  later compare into integer compares instead of a STRICMP() on the
+ *  domain first. k->dom == 0 if fa does not fit (a number above 65534,
+ *  or more domains than the intern table holds).
+ */
+void ftnaddress_to_key (FTN_KEY *k, FTN_ADDR *fa);
+
+/*
+ *  Same result as ftnaddress_cmp (a, b), given ka and kb made from them.
+ */
+int ftnaddress_keycmp (FTN_KEY *ka, FTN_ADDR *a, FTN_KEY *kb, FTN_ADDR *b);
+
 /*
  *  Compare address array with mask, return 0 if any element matches
  */
@@ -23,7 +23,6 @@
 #include "ftnq.h"
 #include "iphdr.h"
 #include "rfc2553.h"
-#include "srv_gai.h"
 
 #if defined(HAVE_THREADS) || defined(AMIGA)
 static MUTEXSEM NSem;
@@ -57,7 +56,112 @@ void nodes_deinit(void)
  */
 static int node_cmp (FTN_NODE **pa, FTN_NODE **pb)
 {
-  return ftnaddress_cmp (&(*pa)->fa, &(*pb)->fa);
+  return ftnaddress_keycmp (&(*pa)->key, &(*pa)->fa, &(*pb)->key, &(*pb)->fa);
+}
+
+/*
+ * Nodes are found through an open-addressing hash keyed by address.
+ * pNodArray only has to be sorted for foreach_node(), so adding a node
+ * costs no search and no re-sort, and loading a config with thousands
+ * of node lines is no longer quadratic. The hash holds the same node
+ * pointers as pNodArray; neither ever drops a node until free_nodes().
+ *
+ * The hash is also what lets get_node_info() skip NSem for a node it
+ * already knows. Slots only ever go from NULL to a fully set up node,
+ * and a table that has to grow is rebuilt aside and then published with
+ * one pointer store; the old one stays on pNodRetired, still readable
+ * by anyone who picked it up a moment ago, until free_nodes().
+ */
+struct node_table
+{
+  struct node_table *next;              /* on pNodRetired */
+  int size;                             /* a power of 2 */
+  FTN_NODE *slot[1];
+};
+
+#if defined(AMIGA)
+/* one CPU: all that must not happen is the compiler sinking the table
+ * stores below the publishing one */
+#define NODE_LOCKFREE
+#define node_publish_barrier() __asm__ __volatile__ ("" ::: "memory")
+#elif defined(__GNUC__)
+#define NODE_LOCKFREE
+#define node_publish_barrier() __sync_synchronize ()
+#endif
+
+/* equal addresses have equal keys, unpacked ones (dom 0) included */
+static unsigned long node_hash (FTN_KEY *k)
+{
+  unsigned long h;
+
+  h = k->hi * 65599UL + k->lo;
+  h = h * 31 + k->dom;
+  return h ^ (h >> 15);
+}
+
+static void node_hash_put (struct node_table *t, FTN_NODE *pn)
+{
+  int i = (int) (node_hash (&pn->key) & (t->size - 1));
+
+  while (t->slot[i])
+    i = (i + 1) & (t->size - 1);
+#ifdef NODE_LOCKFREE
+  node_publish_barrier ();
+#endif
+  t->slot[i] = pn;
+}
+
+/*
+ * Call with NSem locked, once pn is completely filled in
+ */
+static void node_hash_add (FTN_NODE *pn, BINKD_CONFIG *config)
+{
+  struct node_table *t = config->pNodHash;
+
+  /* keep it at most half full */
+  if (t == NULL || config->nNod * 2 > t->size)
+  {
+    int i, size = t ? t->size * 2 : 64;
+
+    while (config->nNod * 2 > size)
+      size *= 2;
+    t = xalloc (sizeof (struct node_table) + (size - 1) * sizeof (FTN_NODE *));
+    memset (t, 0, sizeof (struct node_table) + (size - 1) * sizeof (FTN_NODE *));
+    t->size = size;
+    for (i = 0; i < config->nNod; i++)
+      node_hash_put (t, config->pNodArray[i]);
+    if (config->pNodHash)
+    {
+      config->pNodHash->next = config->pNodRetired;
+      config->pNodRetired = config->pNodHash;
+    }
+#ifdef NODE_LOCKFREE
+    node_publish_barrier ();
+#endif
+    config->pNodHash = t;
+  }
+  else
+    node_hash_put (t, pn);
+}
+
+static FTN_NODE *node_hash_find (FTN_ADDR *fa, BINKD_CONFIG *config)
+{
+  struct node_table *t = config->pNodHash;
+  FTN_NODE *pn;
+  FTN_KEY key;
+  int i;
+
+  if (t == NULL)
+    return NULL;
+  ftnaddress_to_key (&key, fa);
+  i = (int) (node_hash (&key) & (t->size - 1));
+  while ((pn = t->slot[i]) != NULL)
+  {
+    if (!ftnaddress_keycmp (&pn->key, &pn->fa, &key, fa))
+      return pn;
+    i = (i + 1) & (t->size - 1);
+  }
+  return NULL;
 }
 
 /*
@@ -84,23 +188,22 @@ static FTN_NODE *add_node_nolock (FTN_ADDR *fa, char *hosts, char *pwd, char *pk
 #endif
               BINKD_CONFIG *config)
 {
-  int cn;
-  FTN_NODE *pn = NULL; /* avoid compiler warning */
+  FTN_NODE *pn;
+  int is_new = 0;
 
-  for (cn = 0; cn < config->nNod; ++cn)
-  {
-    pn = config->pNodArray[cn];
-    if (!ftnaddress_cmp (&(pn->fa), fa))
-      break;
-  }
   /* Node not found, create new entry */
-  if (cn >= config->nNod)
+  if ((pn = node_hash_find (fa, config)) == NULL)
   {
-    cn = config->nNod;
-    config->pNodArray = xrealloc (config->pNodArray, sizeof (FTN_NODE *) * ++(config->nNod));
-    config->pNodArray[cn] = pn = xalloc(sizeof(FTN_NODE));
+    is_new = 1;
+    if (config->nNod >= config->nNodAlloc)
+    {
+      config->nNodAlloc = config->nNodAlloc ? config->nNodAlloc * 2 : 16;
+      config->pNodArray = xrealloc (config->pNodArray, sizeof (FTN_NODE *) * config->nNodAlloc);
+    }
+    config->pNodArray[config->nNod++] = pn = xalloc(sizeof(FTN_NODE));
     memset (pn, 0, sizeof (FTN_NODE));
     memcpy (&(pn->fa), fa, sizeof (FTN_ADDR));
+    ftnaddress_to_key (&pn->key, &pn->fa);
     strcpy (pn->pwd, "-");
     pn->hosts = NULL;
     pn->obox_flvr = 'f';
@@ -190,6 +293,9 @@ static FTN_NODE *add_node_nolock (FTN_ADDR *fa, char *hosts, char *pwd, char *pk
     pn->ibox = xstrdup (ibox);
   }
 
+  /* only now can lock-free readers be allowed to find it */
+  if (is_new)
+    node_hash_add (pn, config);
   return pn;
 }
 
@@ -224,27 +330,21 @@ FTN_NODE *add_node (FTN_ADDR *fa, char *hosts, char *pwd, char *pkt_pwd, char *o
 
 static FTN_NODE *search_for_node(FTN_NODE *np, BINKD_CONFIG *config)
 {
-  FTN_NODE **npp;
-
-  npp = (FTN_NODE **) bsearch (&np, config->pNodArray, config->nNod, sizeof (FTN_NODE *),
-                               (int (*) (const void *, const void *)) node_cmp);
-  return npp ? *npp : NULL;
+  return node_hash_find (&np->fa, config);
 }
 
+/*
+ * This used to try srv_getaddrinfo() on each defnode host in turn, with
+ * NSem held, and then throw the answer away: the node has been given
+ * the defnode host list verbatim ever since call-time resolution took
+ * over "*" (see call0() in client.c, which resolves outside any lock).
+ * All that lookup did was make every session that wanted node info
+ * wait behind one slow DNS reply. The node record below is what matters,
+ * and recheck (RESOLVE_TTL) decides how often it is rebuilt.
+ */
 static FTN_NODE *get_defnode_info(FTN_ADDR *fa, FTN_NODE *on, BINKD_CONFIG *config)
 {
-  struct addrinfo *ai, hints;
-  int aiErr;
   FTN_NODE n, *np;
-  char host[BINKD_FQDNLEN + 1];       /* current host/port */
-  char port[MAXPORTSTRLEN + 1] = { 0 };
-  int i;
-
-  /* setup hints for getaddrinfo */
-  memset((void *)&hints, 0, sizeof(hints));
-  hints.ai_family = PF_UNSPEC;
-  hints.ai_socktype = SOCK_STREAM;
-  hints.ai_protocol = IPPROTO_TCP;
 
   strcpy(n.fa.domain, "defnode");
   n.fa.z=n.fa.net=n.fa.node=n.fa.p=0;
@@ -253,24 +353,14 @@ static FTN_NODE *get_defnode_info(FTN_ADDR *fa, FTN_NODE *on, BINKD_CONFIG *conf
   if (!np) /* we don't have defnode info */
     return on;
 
-  for (i=1; np->hosts && get_host_and_port(i, host, port, np->hosts, fa, config)==1; i++)
-  {
-    if (!strcmp(host, "-"))
-      continue;
-
-    aiErr = srv_getaddrinfo(host, port[0] ? port : NULL, &hints, &ai);
-    if (aiErr != 0) continue;
-    freeaddrinfo(ai);
-    sprintf (host+strlen(host), ":%s", port);
-    i=0;
-    break;
-  }
-  if (i)
-    strcpy(host, "-");
   /* following section will copy defnode parameters to the node record */
   if (on)
   { /* on contains only passwd */
-    on->hosts=xstrdup(/*host*/np->hosts);
+    /* a lock-free reader may still hold the old string, so it is only
+     * replaced (and leaked) if defnode's hosts really changed */
+    if (np->hosts && (!on->hosts || strcmp (on->hosts, np->hosts)))
+      on->hosts=xstrdup(/*host*/np->hosts);
+    on->recheck=safe_time() + RESOLVE_TTL;
     on->NR_flag=np->NR_flag;
     on->ND_flag=np->ND_flag;
     on->MD_flag=np->MD_flag;
@@ -298,7 +388,6 @@ static FTN_NODE *get_defnode_info(FTN_ADDR *fa, FTN_NODE *on, BINKD_CONFIG *conf
        np->AFF_flag,
 #endif
        config);
-  sort_nodes (config);
   memcpy (&n.fa, fa, sizeof (FTN_ADDR));
   return search_for_node(&n, config);
 }
@@ -309,16 +398,37 @@ static FTN_NODE *get_node_info_nolock (FTN_ADDR *fa, BINKD_CONFIG *config)
 {
   FTN_NODE n, *np;
 
-  if (!config->nNodSorted)
-    sort_nodes (config);
   memcpy (&n.fa, fa, sizeof (FTN_ADDR));
 
   /* search from previously stored nodes */
   np = search_for_node(&n, config);
 
+  /* not in the config: the nodelist knows where it answers, defnode
+   * only guesses; a passwords-only entry may lack hosts too */
+  if ((!np || (np->listed == NL_PASSWORDS && !np->hosts)) &&
+      config->nodelists.first)
+  {
+    char hosts[BINKD_FQDNLEN + MAXSERVNAME + 2];
+
+    if (nodelist_lookup (fa, hosts, sizeof (hosts), config->nodelists.first))
+    {
+      np = add_node_nolock (fa, hosts, NULL, NULL, NULL, '-', NULL, NULL,
+                            NR_USE_OLD, ND_USE_OLD, MD_USE_OLD, RIP_USE_OLD,
+                            HC_USE_OLD, NP_USE_OLD, NULL, AF_USE_OLD,
+#ifdef BW_LIM
+                            BW_DEF, BW_DEF,
+#endif
+#ifdef AF_FORCE
+                            0,
+#endif
+                            config);
+      np->listed |= NL_NODELIST;
+    }
+  }
+
   /* not found or not in config file and recheck required ... */
   if (( !np || 
-        (np->listed != NL_NODE && np->recheck < safe_time())) 
+        (!(np->listed & (NL_NODE | NL_NODELIST)) && np->recheck < safe_time())) 
       && config->havedefnode) 
     /* ... try resolve from defnode */
     np=get_defnode_info(fa, np, config);
@@ -335,35 +445,95 @@ FTN_NODE *get_node_info (FTN_ADDR *fa, BINKD_CONFIG *config)
 {
   FTN_NODE *n;
 
+#ifdef NODE_LOCKFREE
+  /* A node we know, with hosts set and nothing for defnode to redo, is
+   * exactly what get_node_info_nolock() would return: no need for NSem.
+   * ADR(), q_scan_addrs() and the shared-AKA rewrite in send_block() all
+   * land here for every AKA of every session. */
+  if ((n = node_hash_find (fa, config)) != NULL && n->hosts &&
+      ((n->listed & (NL_NODE | NL_NODELIST)) || !config->havedefnode ||
+       n->recheck >= safe_time()))
+    return n;
+#endif
   locknodesem();
   n = get_node_info_nolock(fa, config);
   releasenodesem();
   return n;
 }
 
+int node_add_flvr (FTN_ADDR *fa, char flvr, char type, BINKD_CONFIG *config)
+{
+  FTN_NODE *n;
+
+  locknodesem();
+  if ((n = get_node_info_nolock(fa, config)) != NULL)
+  {
+    if (type == 'm')
+      n->mail_flvr = MAXFLVR (flvr, n->mail_flvr);
+    else
+      n->files_flvr = MAXFLVR (flvr, n->files_flvr);
+  }
+  releasenodesem();
+  return n != NULL;
+}
+
 /*
- * Iterates through nodes while func() == 0.
+ * foreach_node() walks a sorted, read-only copy of pNodArray. The copy
+ * is shared by every walker until a node is added, then the next walker
+ * makes a fresh one; the last walker still on an old copy frees it.
+ * Each call used to copy the whole array under NSem just so func()
+ * could call get_node_info() again.
  */
-int foreach_node (int (*func) (FTN_NODE *, void *), void *arg, BINKD_CONFIG *config)
+struct node_snap
+{
+  int refs;                             /* walkers, +1 while current */
+  int n;
+  FTN_NODE *node[1];
+};
+
+static struct node_snap *node_snap_get (BINKD_CONFIG *config)
 {
-  int nNod, i, rc = 0;
-  FTN_NODE **pNodArray;
+  struct node_snap *sn;
 
   locknodesem();
+  if (!config->nNodSorted || config->pNodSnap == NULL)
+  {
+    if (!config->nNodSorted)
+      sort_nodes (config);
+    sn = xalloc (sizeof (struct node_snap) +
+                 (config->nNod ? config->nNod - 1 : 0) * sizeof (FTN_NODE *));
+    sn->refs = 1;
+    sn->n = config->nNod;
+    memcpy (sn->node, config->pNodArray, config->nNod * sizeof (FTN_NODE *));
+    if (config->pNodSnap && --config->pNodSnap->refs == 0)
+      free (config->pNodSnap);
+    config->pNodSnap = sn;
+  }
+  sn = config->pNodSnap;
+  sn->refs++;
+  releasenodesem();
+  return sn;
+}
 
-  if (!config->nNodSorted)
-    sort_nodes (config);
-
-  /* copy node array and release semaphore */
-  /* avoid deadlock if get_node_info() used by func() */
-  nNod = config->nNod;
-  pNodArray = xalloc(nNod * sizeof(FTN_NODE *));
-  memcpy(pNodArray, config->pNodArray, nNod * sizeof(FTN_NODE *));
+static void node_snap_put (struct node_snap *sn)
+{
+  locknodesem();
+  if (--sn->refs == 0)
+    free (sn);
   releasenodesem();
+}
 
-  for (i = 0; i < nNod; ++i)
+/*
+ * Iterates through nodes while func() == 0.
+ */
+int foreach_node (int (*func) (FTN_NODE *, void *), void *arg, BINKD_CONFIG *config)
+{
+  int i, rc = 0;
+  struct node_snap *sn = node_snap_get (config);
+
+  for (i = 0; i < sn->n; ++i)
   {
-    FTN_NODE *n = pNodArray[i];
+    FTN_NODE *n = sn->node[i];
 
     if (!n->hosts)
       rc = func (get_node_info(&(n->fa), config), arg);
@@ -372,7 +542,7 @@ int foreach_node (int (*func) (FTN_NODE *, void *), void *arg, BINKD_CONFIG *con
     if (rc != 0)
       break;
   }
-  xfree(pNodArray);
+  node_snap_put (sn);
   return rc;
 }
 
@@ -503,5 +673,14 @@ void free_nodes(BINKD_CONFIG *config)
     free(node);
   }
   xfree(config->pNodArray);
+  xfree(config->pNodHash);
+  while (config->pNodRetired)
+  {
+    struct node_table *t = config->pNodRetired;
+
+    config->pNodRetired = t->next;
+    free (t);
+  }
+  xfree(config->pNodSnap);
 }
 
@@ -49,6 +49,10 @@ FTN_NODE *add_node (FTN_ADDR *fa, char *hosts, char *pwd, char *pkt_pwd, char *o
 #define NL_UNLISTED  0                 /* node is unlisted (dynamically added) */
 #define NL_NODE      1                 /* node is listed in binkd config */
 #define NL_PASSWORDS 2                 /* node is listed in passwords file */
+#define NL_NODELIST  4                 /* node was found in a nodelist index */
+/* What "listed" means to skip, check-pkthdr, limit-rate and bandwidth
+ * limits: a nodelist entry only says where to call, it is no config */
+#define NL_LISTED    (NL_NODE | NL_PASSWORDS)
 
 #define NR_ON        1
 #define NR_OFF       0
@@ -83,6 +87,13 @@ FTN_NODE *add_node (FTN_ADDR *fa, char *hosts, char *pwd, char *pkt_pwd, char *o
 
 #define RESOLVE_TTL 3600               /* DNS resolution again after 1 hour */
 
+/*
+ * Raise a node's mail (type 'm') or files flavour to flvr. Done under the
+ * node lock, so concurrent outbound scanners cannot lose each other's
+ * update. 0 == node not found
+ */
+int node_add_flvr (FTN_ADDR *fa, char flvr, char type, BINKD_CONFIG *config);
+
 /*
  * Iterates through nodes while func() == 0.
  */
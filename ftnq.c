@@ -11,6 +11,8 @@
  *  (at your option) any later version. See COPYING.
  */
 
+#define LOG_SUBSYS queue     /* loglevel-queue, see tools.h */
+
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -24,6 +26,8 @@
 #include "ftnaddr.h"
 #include "bsy.h"
 #include "tools.h"
+#include "sem.h"
+#include "common.h"
 #include "readdir.h"
 #include "iphdr.h"
 #ifdef WITH_PERL
@@ -35,6 +39,8 @@ static const char flo_flvrs[] = "icdfhICDFH";
 static const char out_flvrs[] = "icdohICDOH";
 
 static FTNQ *q_add_dir (FTNQ *q, char *dir, FTN_ADDR *fa1, BINKD_CONFIG *config);
+static void q_note_dir (FTNQ *q, char *dir);
+static void q_dirs_free (void);
 FTNQ *q_add_file (FTNQ *q, char *filename, FTN_ADDR *fa1, char flvr, char action, char type, BINKD_CONFIG *config);
 
 /*
@@ -66,29 +72,73 @@ static int qn_free (FTN_NODE *fn, void *arg)
   return 0;
 }
 
+/*
+ * Queue entries are not malloc()ed one by one: after an outage the queue
+ * can hold tens of thousands of them, and a MAXPATHLEN buffer in each
+ * made that tens of megabytes, almost all of it unused. Entries are
+ * carved from Q_CHUNK_SIZE blocks instead, each followed by its path
+ * at its real length, and a block goes back to the heap in one free()
+ * when the last entry in it is released.
+ *
+ * A block is only ever shared by entries of one queue -- q_new_entry()
+ * takes its block from an entry of the queue being added to -- and a
+ * queue belongs to one session (or one scan job), so the counts need no
+ * locking.
+ */
+#define Q_CHUNK_SIZE 8192
+#define Q_ALIGN(n) (((n) + sizeof (double) - 1) & ~(sizeof (double) - 1))
+
+struct q_chunk
+{
+  size_t size;                          /* bytes available in data */
+  size_t used;                          /* bytes handed out */
+  int live;                             /* entries not yet released */
+  union { double align; char data[1]; } u;
+};
+
+static FTNQ *q_new_entry (FTNQ *near, const char *path)
+{
+  struct q_chunk *chunk = near ? near->chunk : NULL;
+  size_t len = strlen (path);
+  size_t need;
+  FTNQ *e;
+
+  if (len > MAXPATHLEN)
+    len = MAXPATHLEN;
+  need = Q_ALIGN (sizeof (FTNQ)) + Q_ALIGN (len + 1);
+  if (chunk == NULL || chunk->used + need > chunk->size)
+  {
+    size_t size = need > Q_CHUNK_SIZE ? need : Q_CHUNK_SIZE;
+
+    chunk = xalloc (sizeof (struct q_chunk) + size);
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->live = 0;
+  }
+  e = (FTNQ *) (chunk->u.data + chunk->used);
+  chunk->used += need;
+  chunk->live++;
+
+  FQ_ZERO (e);
+  ftnaddress_to_key (&e->key, &e->fa);
+  e->chunk = chunk;
+  e->path = (char *) e + Q_ALIGN (sizeof (FTNQ));
+  memcpy (e->path, path, len);
+  e->path[len] = '\0';
+  return e;
+}
+
 void q_free (FTNQ *q, BINKD_CONFIG *config)
 {
   if (q != SCAN_LISTED)
   {
-    FTNQ *last = 0;
+    FTNQ *next;
 
-    while (q)
-    {
-      last = q;
-      q = q->next;
-    }
-    while (last)
+    for (; q; q = next)
     {
-      if (!last->prev)
-      {
-	free (last);
-	break;
-      }
-      else
-      {
-	last = last->prev;
-	xfree (last->next);
-      }
+      next = q->next;
+      if (--q->chunk->live == 0)
+        free (q->chunk);
     }
   }
   else
@@ -113,70 +163,556 @@ static int qn_scan (FTN_NODE *fn, void *arg)
   return 0;
 }
 
-FTNQ *q_scan (FTNQ *q, BINKD_CONFIG *config)
+/*
+ * Scans one domain's outbound (and its zone outbounds, dir.zzz)
+ */
+static FTNQ *q_scan_domain (FTNQ *q, FTN_DOMAIN *curr_domain, BINKD_CONFIG *config)
 {
   char *s;
   char buf[MAXPATHLEN + 1], outb_path[MAXPATHLEN + 1];
+  DIR *dp;
+  struct dirent *de;
+  int len;
+
+  strnzcpy (outb_path, curr_domain->path, sizeof (buf) - 1);
+/* `FOO:/bar means FOO:\..\bar on Amiga */
+#ifndef AMIGA
+  if (outb_path[strlen (outb_path) - 1] == ':')
+    strcat (outb_path, PATH_SEPARATOR);
+#endif
+
+  q_note_dir (q, outb_path);
+  if ((dp = opendir (outb_path)) == 0)
+  {
+    Log (1, "cannot opendir %s: %s", outb_path, strerror (errno));
+    return q;
+  }
+
+  len = strlen (curr_domain->dir);
+  strnzcpy (buf, curr_domain->path, sizeof (buf));
+  strnzcpy (buf + strlen (buf), PATH_SEPARATOR, sizeof (buf) - strlen (buf));
+  s = buf + strlen (buf);
+
+  while ((de = readdir (dp)) != 0)
+  {
+    if (!STRNICMP (de->d_name, curr_domain->dir, len) &&
+	(de->d_name[len] == 0 ||
+	 (de->d_name[len] == '.' && isxdigit (de->d_name[len + 1]))))
+    {
+      FTN_ADDR fa;
+
+      FA_ZERO (&fa);
+#ifdef AMIGADOS_4D_OUTBOUND
+      if (!config->aso)
+#endif
+	fa.z = ((de->d_name[len] == '.') ?
+		strtol (de->d_name + len + 1, (char **) NULL, 16) :
+		curr_domain->z[0]);
+      if (de->d_name[len] == 0 || fa.z != curr_domain->z[0])
+      {
+	strcpy (fa.domain, curr_domain->name);
+	strnzcpy (buf + strlen (buf), de->d_name, sizeof (buf) - strlen (buf));
+	q = q_add_dir (q, buf, &fa, config);
+      }
+      *s = 0;
+    }
+  }
+  closedir (dp);
+  return q;
+}
+
+/*
+ * One unit of q_scan() work: a domain outbound, or (domain == NULL) the
+ * fileboxes of all nodes. Each job builds its own list, q_scan() splices
+ * them together afterwards.
+ */
+struct q_scan_job
+{
+  FTN_DOMAIN *domain;
+  FTNQ *q;
+  BINKD_CONFIG *config;
+  struct q_scan_jobs *jobs;
+};
+
+struct q_scan_jobs
+{
+  int running;
+#if defined(HAVE_THREADS) && !defined(DEBUGCHILD)
+  MUTEXSEM sem;
+  EVENTSEM done;
+#endif
+};
+
+static void q_scan_job_run (struct q_scan_job *job)
+{
+  if (job->domain)
+    job->q = q_scan_domain (job->q, job->domain, job->config);
+  else
+  {
+    struct qn_scan_params qn_params;
+
+    qn_params.pq     = &job->q;
+    qn_params.config = job->config;
+    foreach_node (qn_scan, &qn_params, job->config);
+  }
+}
+
+#if defined(HAVE_THREADS) && !defined(DEBUGCHILD)
+static void q_scan_thread (void *arg)
+{
+  struct q_scan_job *job = *(struct q_scan_job **) arg;
+  struct q_scan_jobs *jobs = job->jobs;
+
+  free (arg);
+  q_scan_job_run (job);
+  LockSem (&jobs->sem);
+  jobs->running--;
+  ReleaseSem (&jobs->sem);
+  PostSem (&jobs->done);
+}
+#endif
+
+/*
+ * With real threads the outbounds are scanned concurrently, one thread
+ * per domain plus one for the fileboxes: with several networks on
+ * different disks a serial scan leaves each disk idle while the others
+ * are read. The result does not depend on the finishing order -- node
+ * flavours only ever go up (node_add_flvr() under the node lock), and a
+ * queue is spliced in job order so it comes out exactly as the serial
+ * scan built it.
+ *
+ * AMIGA stays serial on purpose. branch() there is a CreateNewProcTags()
+ * Process, and the scan opens files (.hld, .stc) through libnix's
+ * unlocked descriptor table -- the cross-file write race described in
+ * README.md. More Processes opening files at once would only make that
+ * more likely, for a scan that runs once per rescan-delay anyway.
+ */
+FTNQ *q_scan (FTNQ *q, BINKD_CONFIG *config)
+{
   FTN_DOMAIN *curr_domain;
-  struct qn_scan_params qn_params;
+  struct q_scan_job *job;
+  struct q_scan_jobs jobs;
+  int i, njobs = 1;                     /* the fileboxes */
 
   for (curr_domain = config->pDomains.first; curr_domain; curr_domain = curr_domain->next)
-  {
-    DIR *dp;
-    struct dirent *de;
-    int len;
+    if (curr_domain->alias4 == 0)
+      njobs++;
+
+  if (q == SCAN_LISTED)
+    q_dirs_free ();
 
+  job = xalloc (njobs * sizeof (*job));
+  memset (job, 0, njobs * sizeof (*job));
+  memset (&jobs, 0, sizeof (jobs));
+  i = 0;
+  for (curr_domain = config->pDomains.first; curr_domain; curr_domain = curr_domain->next)
     if (curr_domain->alias4 == 0)
+      job[i++].domain = curr_domain;
+  for (i = 0; i < njobs; i++)
+  {
+    job[i].q = (q == SCAN_LISTED) ? SCAN_LISTED : NULL;
+    job[i].config = config;
+    job[i].jobs = &jobs;
+  }
+
+#if defined(HAVE_THREADS) && !defined(DEBUGCHILD)
+  InitSem (&jobs.sem);
+  InitEventSem (&jobs.done);
+  for (i = 0; i < njobs; i++)
+  {
+    struct q_scan_job *pjob = job + i;
+
+    LockSem (&jobs.sem);
+    jobs.running++;
+    ReleaseSem (&jobs.sem);
+    if (branch (q_scan_thread, &pjob, sizeof (pjob)) < 0)
     {
-      strnzcpy (outb_path, curr_domain->path, sizeof (buf) - 1);
-/* `FOO:/bar means FOO:\..\bar on Amiga */
-#ifndef AMIGA
-      if (outb_path[strlen (outb_path) - 1] == ':')
-	strcat (outb_path, PATH_SEPARATOR);
+      LockSem (&jobs.sem);
+      jobs.running--;
+      ReleaseSem (&jobs.sem);
+      q_scan_job_run (pjob);            /* no thread, do it ourselves */
+    }
+  }
+  LockSem (&jobs.sem);
+  while (jobs.running > 0)
+  {
+    ReleaseSem (&jobs.sem);
+    WaitSem (&jobs.done, 1);
+    LockSem (&jobs.sem);
+  }
+  ReleaseSem (&jobs.sem);
+  CleanEventSem (&jobs.done);
+  CleanSem (&jobs.sem);
+#else
+  for (i = 0; i < njobs; i++)
+    q_scan_job_run (job + i);
 #endif
 
-      if ((dp = opendir (outb_path)) == 0)
-      {
-	Log (1, "cannot opendir %s: %s", outb_path, strerror (errno));
-	continue;
-      }
+  /* the serial scan prepended every file, so the last job's files lead */
+  if (q != SCAN_LISTED)
+    for (i = 0; i < njobs; i++)
+    {
+      FTNQ *tail;
 
-      len = strlen (curr_domain->dir);
-      strnzcpy (buf, curr_domain->path, sizeof (buf));
-      strnzcpy (buf + strlen (buf), PATH_SEPARATOR, sizeof (buf) - strlen (buf));
-      s = buf + strlen (buf);
+      if (job[i].q == NULL)
+        continue;
+      for (tail = job[i].q; tail->next; tail = tail->next);
+      tail->next = q;
+      if (q)
+        q->prev = tail;
+      q = job[i].q;
+    }
+  xfree (job);
+  return q;
+}
 
-      while ((de = readdir (dp)) != 0)
-      {
-	if (!STRNICMP (de->d_name, curr_domain->dir, len) &&
-	    (de->d_name[len] == 0 ||
-	     (de->d_name[len] == '.' && isxdigit (de->d_name[len + 1]))))
-	{
-	  FTN_ADDR fa;
+/*
+ * Outbound snapshot (queue-snapshot keyword).
+ *
+ * A cold start cannot place its first call until q_scan() has walked
+ * every outbound, .pnt directory and filebox. The client manager's scan
+ * only leaves per-node flavours and holds behind (SCAN_LISTED), so that
+ * is all the snapshot needs to keep, together with the datestamp of every
+ * directory the scan opened. A file appearing or disappearing changes its
+ * directory's datestamp, so if none of them moved the flavours are still
+ * right. do_client() calls from a restored snapshot straight away and
+ * rescans once every node in it has been started, so a snapshot is never
+ * trusted for longer than one round of calls.
+ *
+ * The file is native-endian and only ever read back by the build that
+ * wrote it: the layout word after the magic carries the format version
+ * and the sizes of the raw records, so another build's file is ignored.
+ * Anything unexpected in it just means a cold scan.
+ */
+#define QS_MAGIC "BQS1"
+#define QS_VERSION 2
+#define QS_MAXSIZE (4L * 1024 * 1024)
+
+struct q_dirstamp
+{
+  struct q_dirstamp *next;
+  time_t mtime;                         /* 0 = could not stat it */
+  char path[1];
+};
+
+static struct q_dirstamp *q_dirs;       /* dirs opened by the last scan */
+static char *qs_last;                   /* what is on disk now */
+static size_t qs_last_len;
+
+struct qs_buf
+{
+  char *p;
+  size_t len, size;
+};
+
+static void q_note_dir_add (struct q_dirstamp *d)
+{
+  d->next = q_dirs;
+  q_dirs = d;
+}
+
+static void q_note_dir (FTNQ *q, char *dir)
+{
+  struct q_dirstamp *d;
+  struct stat sb;
+
+  if (q != SCAN_LISTED)
+    return;
+  d = xalloc (sizeof (*d) + strlen (dir));
+  strcpy (d->path, dir);
+  d->mtime = (stat (dir, &sb) == 0) ? sb.st_mtime : 0;
+  threadsafe (q_note_dir_add (d));
+}
 
-	  FA_ZERO (&fa);
+static void q_dirs_free (void)
+{
+  struct q_dirstamp *d;
+
+  while ((d = q_dirs) != NULL)
+  {
+    q_dirs = d->next;
+    free (d);
+  }
+}
+
+static void qs_put (struct qs_buf *b, const void *data, size_t n)
+{
+  if (b->len + n > b->size)
+  {
+    b->size = (b->len + n) * 2 + 256;
+    b->p = xrealloc (b->p, b->size);
+  }
+  memcpy (b->p + b->len, data, n);
+  b->len += n;
+}
+
+static int qs_get (const char **p, const char *end, void *data, size_t n)
+{
+  if ((size_t) (end - *p) < n)
+    return 0;
+  memcpy (data, *p, n);
+  *p += n;
+  return 1;
+}
+
+static unsigned long qs_hash (unsigned long h, const char *s)
+{
+  if (s)
+    for (; *s; s++)
+      h = (h ^ (unsigned char) tolower (*s)) * 16777619UL & 0xffffffffUL;
+  return (h ^ '|') * 16777619UL & 0xffffffffUL;
+}
+
+static int qs_hash_obox (FTN_NODE *fn, void *arg)
+{
+  unsigned long *h = arg;
+  char buf[FTN_ADDR_SZ + 1];
+
+  if (fn && fn->obox)
+  {
+    ftnaddress_to_str (buf, &fn->fa);
+    *h = qs_hash (*h, buf);
+    *h = qs_hash (*h, fn->obox);
+  }
+  return 0;
+}
+
+/* Anything that changes which directories a scan opens */
+static unsigned long qs_fingerprint (BINKD_CONFIG *config)
+{
+  unsigned long h = 2166136261UL;
+  FTN_DOMAIN *d;
+
+  for (d = config->pDomains.first; d; d = d->next)
+    if (d->alias4 == 0)
+    {
+      h = qs_hash (h, d->name);
+      h = qs_hash (h, d->path);
+      h = qs_hash (h, d->dir);
+    }
+  /* through foreach_node(): defnode lookups grow pNodArray under NSem */
+  foreach_node (qs_hash_obox, &h, config);
 #ifdef AMIGADOS_4D_OUTBOUND
-	  if (!config->aso)
+  h = qs_hash (h, config->aso ? "aso" : "bso");
 #endif
-	    fa.z = ((de->d_name[len] == '.') ?
-		    strtol (de->d_name + len + 1, (char **) NULL, 16) :
-		    curr_domain->z[0]);
-	  if (de->d_name[len] == 0 || fa.z != curr_domain->z[0])
-	  {
-	    strcpy (fa.domain, curr_domain->name);
-	    strnzcpy (buf + strlen (buf), de->d_name, sizeof (buf) - strlen (buf));
-	    q = q_add_dir (q, buf, &fa, config);
-	  }
-	  *s = 0;
-	}
-      }
-      closedir (dp);
+#ifdef MAILBOX
+  h = qs_hash (h, config->tfilebox);
+  h = qs_hash (h, config->bfilebox);
+#endif
+  return h;
+}
+
+/* Format version and the sizes the node and dir records depend on */
+static unsigned long qs_layout (void)
+{
+  return (unsigned long) QS_VERSION << 24 |
+         (unsigned long) (sizeof (FTN_ADDR) & 0xfff) << 12 |
+         (unsigned long) (sizeof (long) & 0x3f) << 6 |
+         (unsigned long) (sizeof (unsigned long) & 0x3f);
+}
+
+static int qs_put_node (FTN_NODE *fn, void *arg)
+{
+  struct qs_buf *b = arg;
+  char flvr[2];
+  long hold;
+
+  if (fn == NULL || (!fn->mail_flvr && !fn->files_flvr && !fn->hold_until))
+    return 0;
+  flvr[0] = (char) fn->mail_flvr;
+  flvr[1] = (char) fn->files_flvr;
+  hold = (long) fn->hold_until;
+  qs_put (b, &fn->fa, sizeof (fn->fa));
+  qs_put (b, flvr, sizeof (flvr));
+  qs_put (b, &hold, sizeof (hold));
+  return 0;
+}
+
+void q_snapshot_save (BINKD_CONFIG *config)
+{
+  struct qs_buf b;
+  struct q_dirstamp *d;
+  unsigned long fp, layout;
+  char tmp[MAXPATHLEN + 1];
+  FILE *f;
+  int ok;
+
+  if (!*config->q_snapshot)
+    return;
+
+  memset (&b, 0, sizeof (b));
+  fp = qs_fingerprint (config);
+  layout = qs_layout ();
+  qs_put (&b, QS_MAGIC, 4);
+  qs_put (&b, &layout, sizeof (layout));
+  qs_put (&b, &fp, sizeof (fp));
+  for (d = q_dirs; d; d = d->next)
+  {
+    unsigned short len = (unsigned short) strlen (d->path);
+    long mtime = (long) d->mtime;
+
+    qs_put (&b, &len, sizeof (len));
+    qs_put (&b, d->path, len);
+    qs_put (&b, &mtime, sizeof (mtime));
+  }
+  {
+    unsigned short end = 0;             /* end of the directory list */
+    qs_put (&b, &end, sizeof (end));
+  }
+  foreach_node (qs_put_node, &b, config);
+
+  if (qs_last && qs_last_len == b.len && !memcmp (qs_last, b.p, b.len))
+  {
+    xfree (b.p);                        /* nothing changed since last time */
+    return;
+  }
+
+  strnzcpy (tmp, config->q_snapshot, sizeof (tmp) - 4);
+  strcat (tmp, ".tmp");
+  if ((f = fopen (tmp, "wb")) == NULL)
+  {
+    Log (2, "cannot write queue snapshot %s: %s", tmp, strerror (errno));
+    xfree (b.p);
+    return;
+  }
+  ok = (fwrite (b.p, b.len, 1, f) == 1);
+  if (fclose (f) != 0)
+    ok = 0;
+  /* AmigaDOS Rename() does not replace an existing file */
+  if (ok)
+  {
+    UNLINK (config->q_snapshot);
+    ok = (RENAME (tmp, config->q_snapshot) == 0);
+  }
+  if (!ok)
+  {
+    Log (2, "cannot write queue snapshot %s: %s", config->q_snapshot, strerror (errno));
+    UNLINK (tmp);
+    xfree (b.p);
+    return;
+  }
+  xfree (qs_last);
+  qs_last = b.p;
+  qs_last_len = b.len;
+}
+
+int q_snapshot_load (BINKD_CONFIG *config)
+{
+  FILE *f;
+  long size;
+  char *data, magic[4];
+  const char *p, *end, *nodes;
+  unsigned long fp, layout;
+  unsigned short len = 1;
+  int n_pending = 0, n_nodes = 0;
+
+  if (!*config->q_snapshot || (f = fopen (config->q_snapshot, "rb")) == NULL)
+    return 0;
+  if (fseek (f, 0, SEEK_END) != 0 || (size = ftell (f)) <= 0 ||
+      size > QS_MAXSIZE || fseek (f, 0, SEEK_SET) != 0)
+  {
+    fclose (f);
+    return 0;
+  }
+  data = xalloc (size);
+  if (fread (data, size, 1, f) != 1)
+  {
+    fclose (f);
+    xfree (data);
+    return 0;
+  }
+  fclose (f);
+  p = data;
+  end = data + size;
+
+  if (!qs_get (&p, end, magic, 4) || memcmp (magic, QS_MAGIC, 4) ||
+      !qs_get (&p, end, &layout, sizeof (layout)) || layout != qs_layout ())
+  {
+    Log (4, "queue snapshot %s was written by another build, scanning", config->q_snapshot);
+    xfree (data);
+    return 0;
+  }
+  if (!qs_get (&p, end, &fp, sizeof (fp)) || fp != qs_fingerprint (config))
+  {
+    Log (4, "queue snapshot %s does not match the config, scanning", config->q_snapshot);
+    xfree (data);
+    return 0;
+  }
+
+  /* every directory must still carry the datestamp it had */
+  while (qs_get (&p, end, &len, sizeof (len)) && len != 0)
+  {
+    char path[MAXPATHLEN + 1];
+    long mtime;
+    struct stat sb;
+
+    if (len > MAXPATHLEN || !qs_get (&p, end, path, len) ||
+        !qs_get (&p, end, &mtime, sizeof (mtime)))
+      break;
+    path[len] = '\0';
+    if ((stat (path, &sb) == 0 ? (long) sb.st_mtime : 0L) != mtime)
+    {
+      Log (4, "queue snapshot: %s changed, scanning", path);
+      xfree (data);
+      return 0;
     }
   }
-  qn_params.pq     = &q;
-  qn_params.config = config;
-  foreach_node (qn_scan, &qn_params, config);
-  return q;
+  if (len != 0)
+  {
+    Log (2, "queue snapshot %s is damaged, scanning", config->q_snapshot);
+    xfree (data);
+    return 0;
+  }
+
+  /* a snapshot with nothing to call saves no time: the rescan would be
+   * the first thing to happen anyway */
+  nodes = p;
+  while (p < end)
+  {
+    FTN_ADDR fa;
+    char flvr[2];
+    long hold;
+
+    if (!qs_get (&p, end, &fa, sizeof (fa)) || !qs_get (&p, end, flvr, 2) ||
+        !qs_get (&p, end, &hold, sizeof (hold)))
+    {
+      Log (2, "queue snapshot %s is damaged, scanning", config->q_snapshot);
+      xfree (data);
+      return 0;
+    }
+    if (flvr[0] || flvr[1])
+      n_pending++;
+  }
+  if (n_pending == 0)
+  {
+    xfree (data);
+    return 0;
+  }
+
+  for (p = nodes; p < end; n_nodes++)
+  {
+    FTN_ADDR fa;
+    char flvr[2];
+    long hold;
+    FTN_NODE *node;
+
+    qs_get (&p, end, &fa, sizeof (fa));
+    qs_get (&p, end, flvr, 2);
+    qs_get (&p, end, &hold, sizeof (hold));
+    fa.domain[sizeof (fa.domain) - 1] = '\0';
+    if (flvr[0])
+      node_add_flvr (&fa, flvr[0], 'm', config);
+    if (flvr[1])
+      node_add_flvr (&fa, flvr[1], 'l', config);
+    if (hold > (long) safe_time () && (node = get_node_info (&fa, config)) != NULL)
+      node->hold_until = (time_t) hold;
+  }
+
+  Log (4, "queue snapshot: %i node(s) restored, rescan pending", n_nodes);
+  xfree (qs_last);
+  qs_last = data;
+  qs_last_len = size;
+  return 1;
 }
 
 /*
@@ -279,6 +815,7 @@ static FTNQ *q_scan_box (FTNQ *q, FTN_ADDR *fa, char *boxpath, char flvr, int de
   }
 #endif
   s = buf + strlen (buf);
+  q_note_dir (q, boxpath);
   if ((dp = opendir (boxpath)) != NULL)
   {
     while ((de = readdir (dp)) != 0)
@@ -571,6 +1108,7 @@ static FTNQ *q_add_dir (FTNQ *q, char *dir, FTN_ADDR *fa1, BINKD_CONFIG *config)
   int j;
   char *s;
 
+  q_note_dir (q, dir);
   if ((dp = opendir (dir)) != 0)
   {
     struct dirent *de;
@@ -712,7 +1250,7 @@ static FTNQ *q_add_dir (FTNQ *q, char *dir, FTN_ADDR *fa1, BINKD_CONFIG *config)
 /*
  * Add a file to the queue.
  */
-FTNQ *q_add_file (FTNQ *q, char *filename, FTN_ADDR *fa1, char flvr, char action, char type, BINKD_CONFIG *config)
+static FTNQ *q_add_file_in (FTNQ *q, FTNQ *pool, char *filename, FTN_ADDR *fa1, char flvr, char action, char type, BINKD_CONFIG *config)
 {
   const int argc=3;
   char *argv[3];
@@ -727,14 +1265,19 @@ FTNQ *q_add_file (FTNQ *q, char *filename, FTN_ADDR *fa1, char flvr, char action
    * Recursion in shared aka definitions imply
    * infinite recursion in this function -
    * please, be careful!
+   * Only the node flavours are updated this way: for a real queue the
+   * recursive result has always been discarded.
    */
-  for(chn = config->shares.first;chn;chn = chn->next)
+  if (q == SCAN_LISTED)
   {
-    if (ftnaddress_cmp(fa1,&chn->sha) == 0)
+    for(chn = config->shares.first;chn;chn = chn->next)
     {
-      for(fcn = chn->sfa.first; fcn; fcn = fcn->next)
+      if (ftnaddress_cmp(fa1,&chn->sha) == 0)
       {
-        q_add_file(q,filename,&fcn->fa,flvr,action,type, config);
+        for(fcn = chn->sfa.first; fcn; fcn = fcn->next)
+        {
+          q_add_file(q,filename,&fcn->fa,flvr,action,type, config);
+        }
       }
     }
   }
@@ -770,8 +1313,7 @@ FTNQ *q_add_file (FTNQ *q, char *filename, FTN_ADDR *fa1, char flvr, char action
       }
     }
 
-    new_file = xalloc (sizeof (FTNQ));
-    FQ_ZERO (new_file);
+    new_file = q_new_entry (pool, type == 's' ? argv[0] : filename);
 
     new_file->next = q;
     if (q)
@@ -779,7 +1321,10 @@ FTNQ *q_add_file (FTNQ *q, char *filename, FTN_ADDR *fa1, char flvr, char action
     q = new_file;
 
     if (fa1)
+    {
       memcpy (&q->fa, fa1, sizeof (FTN_ADDR));
+      ftnaddress_to_key (&q->key, &q->fa);
+    }
 
     q->flvr = flvr;
     q->action = action;
@@ -789,26 +1334,18 @@ FTNQ *q_add_file (FTNQ *q, char *filename, FTN_ADDR *fa1, char flvr, char action
     if (type == 's')
     { q->size = (boff_t) strtoumax(argv[1], NULL, 10);
       q->time = safe_atol(argv[2], NULL);
-      strnzcpy (q->path, argv[0], MAXPATHLEN);
     }
-    else
-      strnzcpy (q->path, filename, MAXPATHLEN);
   }
   else
-  {
-    FTN_NODE *node;
-
-    if ((node = get_node_info (fa1, config)) != NULL)
-    {
-      if (type == 'm')
-	node->mail_flvr = MAXFLVR (flvr, node->mail_flvr);
-      else
-	node->files_flvr = MAXFLVR (flvr, node->files_flvr);
-    }
-  }
+    node_add_flvr (fa1, flvr, type, config);
   return q;
 }
 
+FTNQ *q_add_file (FTNQ *q, char *filename, FTN_ADDR *fa1, char flvr, char action, char type, BINKD_CONFIG *config)
+{
+  return q_add_file_in (q, q, filename, fa1, flvr, action, type, config);
+}
+
 /*
  * Add a file to the end of queue.
  */
@@ -816,7 +1353,7 @@ FTNQ *q_add_last_file (FTNQ *q, char *filename, FTN_ADDR *fa1, char flvr, char a
 {
   FTNQ *new_file, *pq;
 
-  new_file = q_add_file (NULL, filename, fa1, flvr, action, type, config);
+  new_file = q_add_file_in (NULL, q, filename, fa1, flvr, action, type, config);
   if (new_file == NULL) return q;
   if (q == NULL) return new_file;
   for (pq = q; pq->next; pq = pq->next);
@@ -891,20 +1428,20 @@ void q_list (FILE *out, FTNQ *q, BINKD_CONFIG *config)
   }
 }
 
-static int q_cmp(FTNQ *a, FTNQ *b, FTN_ADDR *fa, int nAka)
+static int q_cmp(FTNQ *a, FTNQ *b, FTN_ADDR *fa, FTN_KEY *ka, int nAka)
 {
   int i;
 
-  /* 1. Do not sort sent files, move its to the end of queue */
+  /* 1. Do not sort sent files, keep them at the head of queue */
   if (a->sent || b->sent)
     return b->sent - a->sent;
   /* 2. Compare AKA */
-  if (!ftnaddress_cmp (&a->fa, &b->fa)) {
+  if (!ftnaddress_keycmp (&a->key, &a->fa, &b->key, &b->fa)) {
     if (FA_ISNULL(&a->fa)) return -1;
     if (FA_ISNULL(&b->fa)) return 1;
     for (i = 0; i < nAka; i++) {
-      if (!ftnaddress_cmp (&a->fa, fa + i)) return -1;
-      if (!ftnaddress_cmp (&b->fa, fa + i)) return 1;
+      if (!ftnaddress_keycmp (&a->key, &a->fa, ka + i, fa + i)) return -1;
+      if (!ftnaddress_keycmp (&b->key, &b->fa, ka + i, fa + i)) return 1;
     }
     /* Files for different unknown akas? Hmm... */
   }
@@ -933,8 +1470,14 @@ FTNQ *q_sort (FTNQ *q, FTN_ADDR *fa, int nAka, BINKD_CONFIG *cfg)
    * quick/merge/heap or any other effective sorting algorithm
    */
   FTNQ *head, *tail, *qnext, *cur;
+  FTN_KEY *ka;
+  int i;
 
   if (q == NULL) return q;
+  /* the AKAs are compared with every pair: pack them once */
+  ka = xalloc ((nAka ? nAka : 1) * sizeof (FTN_KEY));
+  for (i = 0; i < nAka; i++)
+    ftnaddress_to_key (ka + i, fa + i);
   qnext = q->next;
   head = tail = q;
   q->next = NULL;
@@ -942,7 +1485,7 @@ FTNQ *q_sort (FTNQ *q, FTN_ADDR *fa, int nAka, BINKD_CONFIG *cfg)
     qnext = q->next;
     /* insert q into new queue */
     for (cur = head; cur; cur = cur->next) {
-      if (q_cmp(cur, q, fa, nAka) > 0)
+      if (q_cmp(cur, q, fa, ka, nAka) > 0)
         break;
     }
     q->next = cur;
@@ -959,17 +1502,27 @@ FTNQ *q_sort (FTNQ *q, FTN_ADDR *fa, int nAka, BINKD_CONFIG *cfg)
       tail = q;
     }
   }
+  free (ka);
   return head;
 }
 
 /*
- * Selects from q the next file for fa (Returns a pointer to a q element)
+ * Selects from q the next file to send (Returns a pointer to a q element)
+ *
+ * Walking from the head every time made a session with a big filebox
+ * quadratic: each pick stepped over all the files already sent. Entries
+ * are only ever marked sent here, in list order, so everything up to and
+ * including *cursor is known to be sent and the walk can resume right
+ * after it. q_add_last_file() appends behind the cursor and is picked up
+ * naturally; q_sort() and q_add_file() may move unsent entries in front
+ * of it, so the caller drops the cursor back to NULL after those.
  */
-FTNQ *select_next_file (FTNQ *q, FTN_ADDR *fa, int nAka)
+FTNQ *select_next_file (FTNQ *q, FTNQ **cursor)
 {
   FTNQ *curr;
 
-  for (curr = q; curr; curr = curr->next) {
+  for (curr = *cursor ? (*cursor)->next : q; curr; curr = curr->next) {
+    *cursor = curr;
     if (!curr->sent) { curr->sent = 1; return curr; }
   }
   return NULL;
@@ -49,6 +49,15 @@ FTNQ *q_scan_boxes (FTNQ *q, FTN_ADDR *fa, int n, int to, BINKD_CONFIG *config);
  */
 FTNQ *q_sort (FTNQ *q, FTN_ADDR *fa, int nAka, BINKD_CONFIG *cfg);
 
+/*
+ * queue-snapshot: q_snapshot_save() writes the node flavours and the
+ * directory datestamps of the last SCAN_LISTED scan (only if they
+ * changed), q_snapshot_load() restores them when no scanned directory
+ * has changed since. 1 = restored, the caller should still rescan soon.
+ */
+int q_snapshot_load (BINKD_CONFIG *config);
+void q_snapshot_save (BINKD_CONFIG *config);
+
 /*
  * 0 = the queue is empty.
  */
@@ -61,9 +70,11 @@ FTN_NODE *q_not_empty (BINKD_CONFIG *config);
 FTN_NODE *q_next_node (BINKD_CONFIG *config);
 
 /*
- * Selects from q the next file for fa (Returns a pointer to a q element)
+ * Selects from q the next file to send (Returns a pointer to a q element).
+ * *cursor remembers where the previous call stopped; it must be reset to
+ * NULL whenever q is freed, sorted or gets entries prepended.
  */
-FTNQ *select_next_file (FTNQ *q, FTN_ADDR *fa, int nAka);
+FTNQ *select_next_file (FTNQ *q, FTNQ **cursor);
 
 /*
  * Just lists q, not more
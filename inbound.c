@@ -11,6 +11,8 @@
  *  (at your option) any later version. See COPYING.
  */
 
+#define LOG_SUBSYS inbound   /* loglevel-inbound, see tools.h */
+
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -28,6 +30,8 @@
 #include "ftnaddr.h"
 #include "ftnnode.h"
 #include "srif.h"
+#include "sem.h"
+#include "bsy.h"
 #ifdef WITH_PERL
 #include "perlhooks.h"
 #endif
@@ -44,12 +48,50 @@ static void remove_hr (char *path)
   delete (path);
 }
 
-static int creat_tmp_name (char *s, TFILE *file, FTN_ADDR *from, char *inbound)
+static void partial_add (char *dir, char *hr, TFILE *file, FTN_ADDR *from, char *flags);
+
+/*
+ * Writes the .hr of file: "netname size time aka [flags]". 0 -- error
+ * (logged).
+ */
+static int hr_write (char *s, TFILE *file, FTN_ADDR *from, char *flags)
 {
   FILE *f;
+  char node[FTN_ADDR_SZ + 1];
+
+  if ((f = fopen (s, "w")) == 0)
+  {
+    Log (1, "%s: %s", s, strerror (errno));
+    return 0;
+  }
+  if (from) ftnaddress_to_str (node, from); else strcpy(node, "0:0/0.0@unknown");
+  if (fprintf (f, *flags ? "%s %" PRIuMAX " %" PRIuMAX " %s %s\n"
+                         : "%s %" PRIuMAX " %" PRIuMAX " %s\n", file->netname,
+               (uintmax_t) file->size,
+               (uintmax_t) file->time, node, flags) <= 0)
+  {
+    Log (1, "%s: %s", s, strerror (errno));
+    fclose (f);
+    return 0;
+  }
+  if (fclose (f))
+  {
+    Log (1, "%s: %s", s, strerror (errno));
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * flags (see hr_flags()) go to the .hr as a fifth word: 'S'/'N' --
+ * commit-batch is on and the file goes to the secure or the non-secure
+ * inbound, so that partial_recover() can finish the rename after a crash;
+ * 'P' -- the .dt is preallocated, its size says nothing of what arrived.
+ */
+static int creat_tmp_name (char *s, TFILE *file, FTN_ADDR *from, char *inbound, char *flags)
+{
   char tmp[20];
   char *t;
-  char node[FTN_ADDR_SZ + 1];
 
   strnzcpy (s, inbound, MAXPATHLEN);
   strnzcat (s, PATH_SEPARATOR, MAXPATHLEN);
@@ -60,28 +102,12 @@ static int creat_tmp_name (char *s, TFILE *file, FTN_ADDR *from, char *inbound)
     strnzcat (s, tmp, MAXPATHLEN);
     if (create_empty_sem_file (s))
     {
-      if ((f = fopen (s, "w")) == 0)
-      {
-        Log (1, "%s: %s", s, strerror (errno));
-        delete (s);
-        return 0;
-      }
-      if (from) ftnaddress_to_str (node, from); else strcpy(node, "0:0/0.0@unknown");
-      if (fprintf (f, "%s %" PRIuMAX " %" PRIuMAX " %s\n", file->netname,
-                   (uintmax_t) file->size,
-                   (uintmax_t) file->time, node) <= 0)
+      if (!hr_write (s, file, from, flags))
       {
-        Log (1, "%s: %s", s, strerror (errno));
-        fclose (f);
-        delete (s);
-        return 0;
-      }
-      if (fclose (f))
-      {
-        Log (1, "%s: %s", s, strerror (errno));
         delete (s);
         return 0;
       }
+      partial_add (inbound, t, file, from, flags);
       break;
     }
     *t = 0;
@@ -108,29 +134,204 @@ static int to_be_deleted (char *tmp_name, char *netname, boff_t filesize, BINKD_
 }
 
 /*
- * Searches for the ``file'' in the inbound and returns it's tmp name in s.
- * S must have MAXPATHLEN chars. Returns 0 on error, 1=found, 2=created.
+ * Partial files, one list per temp inbound directory. find_tmp_name() used
+ * to opendir() the inbound and fopen() and parse every *.hr in it for each
+ * file received, sent to inb_done() and rejected -- with a few hundred
+ * partials lying about, every file paid for reading all of them. Now a
+ * directory is read once, the list is kept up to date as .hr files are
+ * made and removed, and inb_sweep_partials() reads it again every
+ * PARTIAL_SWEEP_DELAY seconds from the manager loops. Old-partial cleanup
+ * (kill-old-partial-files) is done by those reads, not per file.
+ *
+ * Partials made by another program or instance are picked up by the next
+ * sweep; until then they are simply not resumed. An entry whose .hr has
+ * gone is dropped when found.
  */
-static int find_tmp_name (char *s, TFILE *file, STATE *state, BINKD_CONFIG *config)
+#define PARTIAL_SWEEP_DELAY 600
+
+struct partial
+{
+  struct partial *next;
+  char hr[16];                         /* xxxxxxxx.hr */
+  char *netname;                       /* NULL: empty or garbage .hr */
+  boff_t size;
+  time_t time;
+  FTN_ADDR fa;                         /* FA_ISNULL: unparsable */
+  char commit;                         /* see creat_tmp_name() */
+  char prealloc;
+  time_t added;
+};
+
+struct partial_dir
+{
+  struct partial_dir *next;
+  struct partial *list;
+  time_t swept;
+  int sweeping;
+  char path[MAXPATHLEN + 1];
+};
+
+#if defined(HAVE_THREADS) || defined(AMIGA)
+static MUTEXSEM partsem;
+#endif
+static struct partial_dir *partial_dirs;
+
+static void dup_init (void);
+
+void inb_init (void)
+{
+  InitSem (&partsem);
+  dup_init ();
+}
+
+static void partial_free (struct partial *p)
+{
+  struct partial *next;
+
+  for (; p; p = next)
+  {
+    next = p->next;
+    xfree (p->netname);
+    free (p);
+  }
+}
+
+/*
+ * Reads dir/hr into a new entry, NULL if it cannot be read at all
+ */
+static struct partial *partial_read (char *path, char *hr, BINKD_CONFIG *config)
 {
+  struct partial *p;
   char buf[MAXPATHLEN + 80];
-  DIR *dp;
-  struct dirent *de;
+  char *w[5];
   FILE *f;
-  int i, found = 0;
-  char *t, *inbound;
+  int i;
 
-  inbound = state->inbound;
-  if (config->temp_inbound[0])
-    inbound = config->temp_inbound;
-
-  if ((dp = opendir (inbound)) == 0)
+  if ((f = fopen (path, "r")) == NULL)
+  {
+    Log (1, "find_tmp_name: %s: %s", hr, strerror (errno));
+    return NULL;
+  }
+  p = xalloc (sizeof (*p));
+  memset (p, 0, sizeof (*p));
+  strnzcpy (p->hr, hr, sizeof (p->hr));
+  FA_ZERO (&p->fa);
+  if (fgets (buf, sizeof (buf), f) != NULL)
   {
-    Log (1, "cannot opendir %s: %s", inbound, strerror (errno));
+    for (i = 0; i < 5; ++i)
+      w[i] = getwordx (buf, i + 1, GWX_NOESC);
+    if (w[3])
+    {
+      p->netname = xstrdup (w[0]);
+      p->size = (boff_t) strtoumax (w[1], NULL, 10);
+      p->time = (time_t) safe_atol (w[2], NULL);
+      if (!parse_ftnaddress (w[3], &p->fa, config->pDomains.first))
+        FA_ZERO (&p->fa);
+      if (w[4])
+      {
+        if (*w[4] == 'S' || *w[4] == 'N')
+          p->commit = *w[4];
+        p->prealloc = strchr (w[4], 'P') != NULL;
+      }
+    }
+    for (i = 0; i < 5; ++i)
+      xfree (w[i]);
+  }
+  fclose (f);
+  return p;
+}
+
+static int inb_rename (char *tmp_name, char *real_name, char *netname,
+                       char *inbound, time_t ftime, BINKD_CONFIG *config);
+
+/*
+ * The .hr flags for file, at most 2 chars and the '\0'
+ */
+static void hr_flags (char *flags, STATE *state, TFILE *file, BINKD_CONFIG *config)
+{
+  if (config->commit_batch > 0)
+    *flags++ = state->inbound == config->inbound ? 'S' : 'N';
+  if (config->prealloc_inbound > 0 &&
+      file->size >= (boff_t) config->prealloc_inbound * 1024)
+    *flags++ = 'P';
+  *flags = 0;
+}
+
+/*
+ * commit-batch sends M_GOT before the rename, so a crash in between
+ * leaves a complete .dt that the remote will not send again. Such a file
+ * (its .hr has the commit mark, the .dt has the full size and has not
+ * been written to for COMMIT_RECOVER_AGE seconds) is renamed here, when
+ * its directory is read. Events and the pkt header check are not run for
+ * it -- there is no session to run them in. 1 -- done, the .hr is gone.
+ *
+ * Age alone does not mean a crash: a large commit-batch on a slow link
+ * keeps a file in a live session's to_commit that long, and renaming it
+ * from under the session makes its commit fail. That session holds the
+ * sender's .bsy (or .csy, if we called), in this process or another
+ * instance, so a partial whose sender is busy is left alone.
+ */
+#define COMMIT_RECOVER_AGE 3600
+
+static int partial_recover (char *hr, struct partial *p, BINKD_CONFIG *config)
+{
+  char dt[MAXPATHLEN + 1], dir[MAXPATHLEN + 1], real_name[MAXPATHLEN + 10];
+  char *s, *u;
+  struct stat sb;
+
+  if (!p->commit || p->prealloc || !p->netname)
+    return 0;
+  strnzcpy (dt, hr, sizeof (dt));
+  strcpy (strrchr (dt, '.'), ".dt");
+  if (stat (dt, &sb) != 0 || (boff_t) sb.st_size != p->size ||
+      time (0) - sb.st_mtime < COMMIT_RECOVER_AGE)
     return 0;
+  if (FA_ISNULL (&p->fa) ||
+      !bsy_test (&p->fa, F_BSY, config) || !bsy_test (&p->fa, F_CSY, config))
+    return 0;
+  if (config->temp_inbound[0])
+    strnzcpy (dir, p->commit == 'S' ? config->inbound : config->inbound_nonsecure,
+              sizeof (dir));
+  else
+  {
+    strnzcpy (dir, hr, sizeof (dir));
+    if ((s = last_slash (dir)) == NULL)
+      return 0;
+    *s = 0;
   }
+  strnzcpy (real_name, dir, MAXPATHLEN);
+  strnzcat (real_name, PATH_SEPARATOR, MAXPATHLEN);
+  s = real_name + strlen (real_name);
+  strnzcat (real_name, u = makeinboundcase (strdequote (p->netname), (int)config->inboundcase), MAXPATHLEN);
+  free (u);
+  strwipe (s);
+  if (!inb_rename (dt, real_name, p->netname, dir, p->time, config))
+    return 0;
+  Log (2, "recovered %s from an unfinished commit: %s", p->netname, real_name);
+  delete (hr);
+  return 1;
+}
 
-  strnzcpy (s, inbound, MAXPATHLEN);
+/*
+ * Reads all *.hr in dir, removing the old ones on the way. *ok = 0 if
+ * the directory cannot be read.
+ */
+static struct partial *partial_scan (char *dir, time_t now, int *ok, BINKD_CONFIG *config)
+{
+  char s[MAXPATHLEN + 1], *t;
+  struct partial *list = NULL, *p;
+  struct dirent *de;
+  DIR *dp;
+  int i;
+
+  if ((dp = opendir (dir)) == 0)
+  {
+    Log (1, "cannot opendir %s: %s", dir, strerror (errno));
+    *ok = 0;
+    return NULL;
+  }
+  *ok = 1;
+  strnzcpy (s, dir, MAXPATHLEN);
   strnzcat (s, PATH_SEPARATOR, MAXPATHLEN);
   t = s + strlen (s);
   while ((de = readdir (dp)) != 0)
@@ -140,105 +341,331 @@ static int find_tmp_name (char *s, TFILE *file, STATE *state, BINKD_CONFIG *conf
         break;
     if (i < 8 || STRICMP (de->d_name + 8, ".hr"))
       continue;
+    *t = 0;
     strnzcat (s, de->d_name, MAXPATHLEN);
-
-    if ((f = fopen (s, "r")) == NULL)
+    if ((p = partial_read (s, de->d_name, config)) == NULL)
+      continue;
+    if (partial_recover (s, p, config))
     {
-      Log (1, "find_tmp_name: %s: %s", de->d_name, strerror (errno));
+      partial_free (p);
+      continue;
     }
-    else if (fgets (buf, sizeof (buf), f)==NULL)
-    {  /* This .hr is empty, now checks to old */
-      fclose (f);
-      if (to_be_deleted (s, "unknown", (boff_t)-1, config))
+    if (to_be_deleted (s, p->netname ? p->netname : "unknown",
+                       p->netname ? p->size : (boff_t)-1, config))
+    {
+      Log (5, "old partial file %s removed", p->netname ? p->netname : de->d_name);
+      remove_hr (s);
+      partial_free (p);
+      continue;
+    }
+    p->added = now;
+    p->next = list;
+    list = p;
+  }
+  closedir (dp);
+  return list;
+}
+
+/*
+ * The list for dir, read now if this is the first time. NULL on error.
+ */
+static struct partial_dir *partial_dir_get (char *dir, BINKD_CONFIG *config)
+{
+  struct partial_dir *pd;
+  struct partial *list;
+  time_t now = time (0);
+  int ok;
+
+  LockSem (&partsem);
+  for (pd = partial_dirs; pd; pd = pd->next)
+    if (!strcmp (pd->path, dir))
+      break;
+  ReleaseSem (&partsem);
+  if (pd)
+    return pd;
+
+  list = partial_scan (dir, now, &ok, config);
+  if (!ok)
+    return NULL;
+  LockSem (&partsem);
+  for (pd = partial_dirs; pd; pd = pd->next)
+    if (!strcmp (pd->path, dir))
+      break;
+  if (pd == NULL)                      /* else a sibling was quicker */
+  {
+    pd = xalloc (sizeof (*pd));
+    memset (pd, 0, sizeof (*pd));
+    strnzcpy (pd->path, dir, sizeof (pd->path));
+    pd->list = list;
+    pd->swept = now;
+    pd->next = partial_dirs;
+    partial_dirs = pd;
+    list = NULL;
+  }
+  ReleaseSem (&partsem);
+  partial_free (list);
+  return pd;
+}
+
+/*
+ * Remembers the .hr creat_tmp_name() has just written
+ */
+static void partial_add (char *dir, char *hr, TFILE *file, FTN_ADDR *from, char *flags)
+{
+  struct partial_dir *pd;
+  struct partial *p;
+
+  p = xalloc (sizeof (*p));
+  memset (p, 0, sizeof (*p));
+  strnzcpy (p->hr, hr, sizeof (p->hr));
+  p->netname = xstrdup (file->netname);
+  p->size = file->size;
+  p->time = file->time;
+  if (from)
+    memcpy (&p->fa, from, sizeof (FTN_ADDR));
+  else
+    FA_ZERO (&p->fa);
+  if (*flags == 'S' || *flags == 'N')
+    p->commit = *flags;
+  p->prealloc = strchr (flags, 'P') != NULL;
+  p->added = time (0);
+  LockSem (&partsem);
+  for (pd = partial_dirs; pd; pd = pd->next)
+    if (!strcmp (pd->path, dir))
+      break;
+  if (pd)                              /* else the first read will see it */
+  {
+    p->next = pd->list;
+    pd->list = p;
+    p = NULL;
+  }
+  ReleaseSem (&partsem);
+  partial_free (p);
+}
+
+/*
+ * Forgets the partial of path (its .hr or .dt)
+ */
+static void partial_drop (char *path)
+{
+  char dir[MAXPATHLEN + 1], *hr;
+  struct partial_dir *pd;
+  struct partial **pp, *p = NULL;
+  int n;
+
+  strnzcpy (dir, path, sizeof (dir));
+  if ((hr = last_slash (dir)) == NULL)
+    return;
+  *hr++ = 0;
+  n = (int) (strrchr (hr, '.') - hr);
+  LockSem (&partsem);
+  for (pd = partial_dirs; pd; pd = pd->next)
+    if (!strcmp (pd->path, dir))
+      break;
+  if (pd)
+    for (pp = &pd->list; (p = *pp) != NULL; pp = &p->next)
+      if (!strncmp (p->hr, hr, n) && p->hr[n] == '.')
       {
-        Log (5, "old empty partial file %s is removed", de->d_name);
-        remove_hr (s);
+        *pp = p->next;
+        p->next = NULL;
+        break;
       }
-    }
-    else
-    {
-      char *w[4];
-      FTN_ADDR fa;
+  ReleaseSem (&partsem);
+  partial_free (p);
+}
 
-      fclose (f);
-      FA_ZERO (&fa);
-      for (i = 0; i < 4; ++i)
-        w[i] = getwordx (buf, i + 1, GWX_NOESC);
-      if (!w[3])
+/*
+ * Clears the 'P' of the partial of path (its .hr) in the list
+ */
+static void partial_unmark (char *path)
+{
+  char dir[MAXPATHLEN + 1], *hr;
+  struct partial_dir *pd;
+  struct partial *p;
+
+  strnzcpy (dir, path, sizeof (dir));
+  if ((hr = last_slash (dir)) == NULL)
+    return;
+  *hr++ = 0;
+  LockSem (&partsem);
+  for (pd = partial_dirs; pd; pd = pd->next)
+    if (!strcmp (pd->path, dir))
+      break;
+  if (pd)
+    for (p = pd->list; p; p = p->next)
+      if (!strcmp (p->hr, hr))
       {
-        if (to_be_deleted (s, "unknown", (boff_t)-1, config))
-        {
-          Log (5, "old partial file %s with garbage is removed", de->d_name);
-          remove_hr (s);
-        }
+        p->prealloc = 0;
+        break;
       }
-      else
+  ReleaseSem (&partsem);
+}
+
+/*
+ * Reads the partial directories again, if it is time. For the manager loops.
+ */
+void inb_sweep_partials (BINKD_CONFIG *config)
+{
+  struct partial_dir *pd;
+  struct partial *list, *p, **pp, *old;
+  time_t now = time (0);
+  char dir[MAXPATHLEN + 1];
+  int ok;
+
+  for (pd = partial_dirs; pd; pd = pd->next)
+  {
+    if (now - pd->swept < PARTIAL_SWEEP_DELAY && now >= pd->swept)
+      continue;
+    LockSem (&partsem);
+    ok = !pd->sweeping;
+    pd->sweeping = 1;
+    strcpy (dir, pd->path);
+    ReleaseSem (&partsem);
+    if (!ok)
+      continue;
+
+    list = partial_scan (dir, now, &ok, config);
+    LockSem (&partsem);
+    old = pd->list;
+    if (ok)
+    {
+      /* keep what sessions added while we were reading */
+      for (pp = &old; (p = *pp) != NULL;)
       {
-        i = -1;
-        if (parse_ftnaddress (w[3], &fa, config->pDomains.first))
-          for (i = 0; i < state->nallfa; i++)
-            if (!ftnaddress_cmp (&fa, state->fa + i))
-              break;
+        struct partial *q;
 
-        if (file == NULL)
+        for (q = list; q; q = q->next)
+          if (!strcmp (q->hr, p->hr))
+            break;
+        if (q == NULL && p->added >= now)
         {
-          if (i >= 0 && i < state->nallfa && !state->skip_all_flag)
-          {
-            Log (5, "partial file %s removed", w[0]);
-            remove_hr (s);
-          }
+          *pp = p->next;
+          p->next = list;
+          list = p;
         }
-        else if (i >= 0 && !strcmp (w[0], file->netname))
-        {
-          if (file->size == (boff_t) strtoumax (w[1], NULL, 10) &&
-              (file->time & ~1) == (time_t) (safe_atol (w[2], NULL) & ~1) &&
-              i < state->nallfa)
-          { /* non-destructive skip file from busy aka */
-            if (i >= state->nfa)
-            {
-              Log (2, "Skip partial file %s: aka %s busy", w[0], w[3]);
-              for (i = 0; i < 4; ++i)
-                xfree (w[i]);
-              return 0;
-            }
-            else
-              found = 1;
-          }
-          else if (config->kill_dup_partial_files && i < state->nallfa)
+        else
+          pp = &p->next;
+      }
+      pd->list = list;
+    }
+    else
+      old = NULL;
+    pd->swept = now;
+    pd->sweeping = 0;
+    ReleaseSem (&partsem);
+    partial_free (old);
+  }
+}
+
+/*
+ * Searches for the ``file'' in the inbound and returns it's tmp name in s.
+ * S must have MAXPATHLEN chars. Returns 0 on error, 1=found, 2=created.
+ */
+static int find_tmp_name (char *s, TFILE *file, STATE *state, BINKD_CONFIG *config)
+{
+  struct partial_dir *pd;
+  struct partial *p, **pp, *gone = NULL;
+  char busy_aka[FTN_ADDR_SZ + 1], hr[16], flags[4];
+  struct stat sb;
+  int i, found = 0, prealloc = 0;
+  char *t, *inbound;
+
+  inbound = state->inbound;
+  if (config->temp_inbound[0])
+    inbound = config->temp_inbound;
+
+  if ((pd = partial_dir_get (inbound, config)) == NULL)
+    return 0;
+
+  strnzcpy (s, inbound, MAXPATHLEN);
+  strnzcat (s, PATH_SEPARATOR, MAXPATHLEN);
+  t = s + strlen (s);
+  *busy_aka = 0;
+  LockSem (&partsem);
+  for (pp = &pd->list; (p = *pp) != NULL;)
+  {
+    int kill = 0;
+
+    /* garbage and unparsable addresses are left to the sweep */
+    if (p->netname && !FA_ISNULL (&p->fa))
+    {
+      for (i = 0; i < state->nallfa; i++)
+        if (!ftnaddress_cmp (&p->fa, state->fa + i))
+          break;
+      if (i == state->nallfa)
+        ;                              /* not this remote's */
+      else if (file == NULL)
+        kill = !state->skip_all_flag;
+      else if (!strcmp (p->netname, file->netname))
+      {
+        if (file->size == p->size && (file->time & ~1) == (p->time & ~1))
+        { /* non-destructive skip file from busy aka */
+          if (i >= state->nfa)
+            ftnaddress_to_str (busy_aka, &p->fa);
+          else
           {
-            Log (5, "dup partial file %s removed", w[0]);
-            remove_hr (s);
+            strnzcpy (hr, p->hr, sizeof (hr));
+            prealloc = p->prealloc;
+            found = 1;
           }
+          break;
         }
-        else if (to_be_deleted (s, w[0], strtoumax (w[1], NULL, 10), config))
-        {
-          Log (5, "old partial file %s removed", w[0]);
-          remove_hr (s);
-        }
-
-        for (i = 0; i < 4; ++i)
-          xfree (w[i]);
+        kill = config->kill_dup_partial_files;
       }
     }
-    if (found)
-      break;
+    if (kill)
+    {
+      *pp = p->next;
+      p->next = gone;
+      gone = p;
+    }
     else
-      *t = 0;
+      pp = &p->next;
+  }
+  ReleaseSem (&partsem);
+
+  while ((p = gone) != NULL)
+  {
+    gone = p->next;
+    Log (5, "%spartial file %s removed", file ? "dup " : "", p->netname);
+    *t = 0;
+    strnzcat (s, p->hr, MAXPATHLEN);
+    remove_hr (s);
+    p->next = NULL;
+    partial_free (p);
+  }
+  *t = 0;
+  if (*busy_aka)
+  {
+    Log (2, "Skip partial file %s: aka %s busy", file->netname, busy_aka);
+    return 0;
   }
-  closedir (dp);
 
   if (file == NULL)
     return 0;
 
+  if (found)
+  {
+    strnzcat (s, hr, MAXPATHLEN);
+    if (stat (s, &sb) != 0)            /* removed behind our back */
+    {
+      partial_drop (s);
+      *t = 0;
+      found = 0;
+    }
+  }
   /* New file */
   if (!found)
   {
     Log (5, "file not found, trying to create a tmpname");
-    if (creat_tmp_name (s, file, state->fa, inbound))
+    hr_flags (flags, state, file, config);
+    if (creat_tmp_name (s, file, state->fa, inbound, flags))
       found = 2;
     else
       return 0;
+    prealloc = strchr (flags, 'P') != NULL;
   }
+  file->prealloc = prealloc;
 
   /* Replacing .hr with .dt */
   strcpy (strrchr (s, '.'), ".dt");
@@ -259,6 +686,7 @@ FILE *inb_fopen (STATE *state, BINKD_CONFIG *config)
   FILE *f;
   int fd;
 #ifdef AMIGA
+  char flags[4];
   int retried_fresh = 0;
 #endif
 
@@ -266,17 +694,29 @@ FILE *inb_fopen (STATE *state, BINKD_CONFIG *config)
     return 0;
 
 fopen_again:
-  if ((fd = open (buf, O_CREAT|O_APPEND|O_RDWR|O_BINARY|O_NOINHERIT, 0666)) == -1)
+  /* A preallocated .dt that was not cut back (see inb_prealloc_end()) was
+   * left by a crash: how much of it is data is unknown, start it over. */
+  if (state->in.prealloc && stat (buf, &sb) == 0 && sb.st_size > 0)
+  {
+    Log (2, "%s: preallocated partial of unknown length, receiving it again",
+         state->in.netname);
+    if (trunc_file (buf))
+      return 0;
+  }
+  /* Not O_APPEND for a preallocated one: writes go from offset 0 into the
+   * space already given to the file. */
+  if ((fd = open (buf, O_CREAT|(state->in.prealloc ? 0 : O_APPEND)|O_RDWR|O_BINARY|O_NOINHERIT, 0666)) == -1)
   {
     Log (1, "%s: %s", buf, strerror (errno));
     return 0;
   }
-  if ((f = fdopen (fd, "ab")) == 0)
+  if ((f = fdopen (fd, state->in.prealloc ? "r+b" : "ab")) == 0)
   {
     Log (1, "%s: %s", buf, strerror (errno));
     return 0;
   }
-  fseeko(f, 0, SEEK_END);               /* Work-around MSVC bug */
+  if (!state->in.prealloc)
+    fseeko(f, 0, SEEK_END);             /* Work-around MSVC bug */
 
 #ifdef AMIGA
   /* Prove the handle is usable before building a session on it.
@@ -296,10 +736,13 @@ fopen_again:
       Log (3, "%s is in use by another session, taking a fresh temp name", buf);
       retried_fresh = 1;
       fclose (f);
+      hr_flags (flags, state, &(state->in), config);
       if (!creat_tmp_name (buf, &(state->in), state->fa,
                            config->temp_inbound[0] ? config->temp_inbound
-                                                   : state->inbound))
+                                                   : state->inbound,
+                           flags))
         return 0;
+      state->in.prealloc = strchr (flags, 'P') != NULL;
       strcpy (strrchr (buf, '.'), ".dt");
       goto fopen_again;
     }
@@ -353,9 +796,86 @@ fopen_again:
   else
     Log (1, "%s: fstat: %s", state->in.netname, strerror (errno));
 
+  if (state->in.prealloc)
+    strnzcpy (state->in.path, buf, sizeof (state->in.path));
   return f;
 }
 
+/*
+ * Gives the whole file its space: the filesystem can then allocate it in
+ * one run instead of a block at a time as the data trickles in. Not done
+ * in inb_fopen(): a file opened only to ask the remote for an offset
+ * (M_GET) must stay empty, or the next M_FILE finds a full-size .dt of
+ * unknown content. The session's handle is closed around the resize:
+ * on AmigaOS a second open of a file we hold open succeeds but fails
+ * every operation after (see inb_fopen()), so SetFileSize() by path
+ * would never take. If the resize fails the file is simply written as
+ * it comes; the 'P' in the .hr stays, which is safe.
+ * -1 -- the file could not be opened again, state->in.f is NULL.
+ */
+int inb_prealloc (STATE *state)
+{
+  struct stat sb;
+  int fd, rc;
+
+  if (!state->in.prealloc || !state->in.path[0] || state->in.size <= 0 ||
+      fstat (fileno (state->in.f), &sb) != 0 || sb.st_size != 0)
+    return 0;
+  fclose (state->in.f);
+  state->in.f = NULL;
+  rc = set_file_size (state->in.path, state->in.size);
+  /* As in inb_fopen(); the file is empty or ours in full, so writes go
+   * from offset 0, which is where a fresh handle stands */
+  if ((fd = open (state->in.path, O_RDWR|O_BINARY|O_NOINHERIT)) == -1 ||
+      (state->in.f = fdopen (fd, "r+b")) == NULL)
+  {
+    Log (1, "%s: %s", state->in.path, strerror (errno));
+    if (fd != -1)
+      close (fd);
+    return -1;
+  }
+#if defined(OS2)
+  DosSetFHState(fileno(state->in.f), OPEN_FLAGS_NOINHERIT);
+#elif defined(EMX)
+  fcntl(fileno(state->in.f), F_SETFD, FD_CLOEXEC);
+#endif
+  if (rc == 0)
+    Log (5, "preallocated %" PRIuMAX " bytes for %s",
+         (uintmax_t) state->in.size, state->in.netname);
+  else
+    Log (4, "cannot preallocate %s, receiving it as usual", state->in.path);
+  return 0;
+}
+
+/*
+ * A preallocated file is done with (have bytes of it arrived, the rest
+ * will come in a later session or not at all): cuts the .dt back to have
+ * and drops the 'P' from its .hr, so that it can be resumed or recovered
+ * like any other partial. If the cut fails the 'P' stays and the partial
+ * will be received again.
+ */
+void inb_prealloc_end (STATE *state, TFILE *file, boff_t have, BINKD_CONFIG *config)
+{
+  char hr[MAXPATHLEN + 1], flags[4], *p;
+
+  if (!file->prealloc || !file->path[0])
+    return;
+  if (have < file->size && set_file_size (file->path, have) != 0)
+  {
+    Log (1, "cannot cut %s back to %" PRIuMAX " bytes, it will be received again",
+         file->path, (uintmax_t) have);
+    return;
+  }
+  strnzcpy (hr, file->path, sizeof (hr));
+  strcpy (strrchr (hr, '.'), ".hr");
+  hr_flags (flags, state, file, config);
+  if ((p = strchr (flags, 'P')) != NULL)
+    *p = 0;
+  if (hr_write (hr, file, state->fa, flags))
+    partial_unmark (hr);
+  file->prealloc = 0;
+}
+
 int inb_reject (STATE *state, BINKD_CONFIG *config)
 {
   char tmp_name[MAXPATHLEN + 1];
@@ -369,27 +889,32 @@ int inb_reject (STATE *state, BINKD_CONFIG *config)
   {
     /* Replacing .dt with .hr and removing temp. file */
     strcpy (strrchr (tmp_name, '.'), ".hr");
+    partial_drop (tmp_name);
     remove_hr (tmp_name);
     return 1;
   }
 }
 
-/* val: check if pkt header is one of the session aka */
-int check_pkthdr(STATE *state, char *netname, char *tmp_name,
-                 char *real_name, BINKD_CONFIG *config) {
+/*
+ * Whether check-pkthdr applies to this session. It depends only on the
+ * remote's akas, so it is worked out once, on the first .pkt.
+ */
+static int pkthdr_wanted (STATE *state, BINKD_CONFIG *config)
+{
   FTN_NODE *node;
-  FILE *PKT;
-  unsigned char buf[58];
   int i, check = 0, listed = 0, secure = (state->state == P_SECURE);
-  short cz, cn, cf, cp;
+
+  if (state->pkthdr_check)
+    return state->pkthdr_check == 1;
+  state->pkthdr_check = 2;
   /* ext not defined - no check */
-  if (config->pkthdr_bad == NULL) return 1;
+  if (config->pkthdr_bad == NULL) return 0;
   /* lookup in node records */
   for (i = 0; i < state->nallfa; i++)
     if ( (node = get_node_info(state->fa+i, config)) != NULL ) {
       if (node->fa.z > 0) listed = 1;
       /* no check is forced */
-      if (node->HC_flag == HC_OFF) return 1;
+      if (node->HC_flag == HC_OFF) return 0;
       /* check is on for one aka */
       else if (node->HC_flag == HC_ON) check = 1;
     }
@@ -400,31 +925,61 @@ int check_pkthdr(STATE *state, char *netname, char *tmp_name,
          (config->pkthdr_type == A_UNPROT && secure) ||
          (config->pkthdr_type == A_LST && !listed) ||
          (config->pkthdr_type == A_UNLST && listed) )
-     ) return 1;
-  /* parse pkt header */
-  check = 0;
-  if ( (PKT = fopen(tmp_name, "rb")) == NULL )
+     ) return 0;
+  state->pkthdr_check = 1;
+  return 1;
+}
+
+/* val: check if pkt header is one of the session aka.
+ * 1 -- ok or no check, 2 -- bad (logged). */
+int inb_pkthdr (STATE *state, unsigned char *buf, char *netname, BINKD_CONFIG *config)
+{
+  int i;
+  short cz, cn, cf, cp;
+
+  if (!pkthdr_wanted (state, config))
+    return 1;
+  if ( !pkt_getaddr(buf, &cz, &cn, &cf, &cp, NULL, NULL, NULL, NULL) ) {
+    Log (1, "pkt %s version is %d, expected 2; header check failed", netname, buf[18]+buf[19]*0x100);
+    return 2;
+  }
+  Log (5, "pkt addr is %d:%d/%d.%d for %s", cz, cn, cf, cp, netname);
+  /* do check */
+  for (i = 0; i < state->nallfa; i++)
+    if ( (cz < 0 || (state->fa+i)->z == cz) &&
+         (cn < 0 || (state->fa+i)->net == cn ) &&
+         ( (state->fa+i)->node == cf ) &&
+         (cp < 0 || (state->fa+i)->p == cp) )
+      return 1;
+  Log (1, "bad pkt addr: %d:%d/%d.%d (file %s)", cz, cn, cf, cp, netname);
+  return 2;
+}
+
+/* Renames real_name to the check-pkthdr extension if the header is bad.
+ * Uses the verdict taken while the file came in (recv_block()); only a
+ * resumed transfer, which did not see the header, has it read back. */
+static int check_pkthdr(STATE *state, TFILE *file, char *tmp_name,
+                        char *real_name, BINKD_CONFIG *config) {
+  FILE *PKT;
+  unsigned char buf[PKT_HDR_SIZE];
+  char *netname = file->netname;
+  int i, check, ok = file->pkthdr_ok;
+
+  if (!pkthdr_wanted (state, config)) return 1;
+  if (!ok) {
+    ok = 2;
+    if ( (PKT = fopen(tmp_name, "rb")) == NULL )
       Log (1, "can't open file %s: %s, header check failed for %s", tmp_name, strerror (errno), netname);
-  else if ( !fread(buf, sizeof(buf), 1, PKT) )
-      Log (1, "file %s read error: %s, header check failed for %s", tmp_name, strerror (errno), netname);
-  else if ( !pkt_getaddr(buf, &cz, &cn, &cf, &cp, NULL, NULL, NULL, NULL) )
-      Log (1, "pkt %s version is %d, expected 2; header check failed", netname, buf[18]+buf[19]*0x100);
-  else {
-    check = 1;
-    Log (5, "pkt addr is %d:%d/%d.%d for %s", cz, cn, cf, cp, netname);
-    /* do check */
-    for (i = 0; i < state->nallfa; i++)
-      if ( (cz < 0 || (state->fa+i)->z == cz) &&
-           (cn < 0 || (state->fa+i)->net == cn ) &&
-           ( (state->fa+i)->node == cf ) &&
-           (cp < 0 || (state->fa+i)->p == cp) ) {
-                                             if (PKT != NULL) fclose(PKT);
-                                             return 1;
-                                           }
-  }
-  if (PKT != NULL) fclose(PKT);
+    else {
+      if ( !fread(buf, sizeof(buf), 1, PKT) )
+        Log (1, "file %s read error: %s, header check failed for %s", tmp_name, strerror (errno), netname);
+      else
+        ok = inb_pkthdr (state, buf, netname, config);
+      fclose(PKT);
+    }
+  }
+  if (ok == 1) return 1;
   /* change pkt ext to bad */
-  if (check) Log (1, "bad pkt addr: %d:%d/%d.%d (file %s)", cz, cn, cf, cp, netname);
   i = strlen(real_name); check = 0;
   while (i > 0 && real_name[--i] != '.') check++;
   if (i > 0) {
@@ -486,44 +1041,16 @@ static int next_inb_filename (char *fname, char **s, enum renamestyletype ren_st
 }
 
 /*
- * File is complete, rename it to it's realname. 1=ok, 0=failed.
+ * Renames a complete tmp_name to real_name in inbound, or to the next
+ * free name after it. 1=ok, 0=failed (logged).
  */
-int inb_done (TFILE *file, STATE *state, BINKD_CONFIG *config)
+static int inb_rename (char *tmp_name, char *real_name, char *netname,
+                       char *inbound, time_t ftime, BINKD_CONFIG *config)
 {
-  char tmp_name[MAXPATHLEN + 1];
-  char real_name[MAXPATHLEN + 10];
-  char szAddr[FTN_ADDR_SZ + 1];
-  char *s, *u, *netname;
+  char *s, *u;
   int  unlinked = 0, i;
   enum renamestyletype ren_style;
 
-  *real_name = 0;
-  netname = file->netname;
-
-  if (find_tmp_name (tmp_name, file, state, config) != 1)
-  {
-    Log (1, "missing tmp file for %s!", netname);
-    return 0;
-  }
-
-
-  strnzcpy (real_name, state->inbound, MAXPATHLEN);
-  strnzcat (real_name, PATH_SEPARATOR, MAXPATHLEN);
-  s = real_name + strlen (real_name);
-  strnzcat (real_name, u = makeinboundcase (strdequote (netname), (int)config->inboundcase), MAXPATHLEN);
-  free (u);
-  strwipe (s);
-
-#ifdef WITH_PERL
-  if (perl_after_recv(state, file, tmp_name, real_name)) {
-    /* Replacing .dt with .hr and removing temp. file */
-    if (access(tmp_name, 0) == 0) sdelete (tmp_name);
-    strcpy (strrchr (tmp_name, '.'), ".hr");
-    sdelete (tmp_name);
-    return 1;
-  }
-#endif
-
   if (mask_test(netname, config->overwrite.first) && !ispkt(netname) && !isarcmail(netname))
   {
     for (i=0; ; i++)
@@ -538,18 +1065,11 @@ int inb_done (TFILE *file, STATE *state, BINKD_CONFIG *config)
       {
         Log (1, "cannot rename %s to it's realname: %s! (data stored in %s)",
              netname, strerror (errno), tmp_name);
-        *real_name = 0;
         return 0;
       }
     }
   } else
   {
-    /* check pkt file header */
-    if (ispkt (netname))
-    {
-      check_pkthdr(state, netname, tmp_name, real_name, config);
-    }
-
     s = real_name + strlen (real_name);
 
     ren_style = config->renamestyle;
@@ -566,7 +1086,7 @@ int inb_done (TFILE *file, STATE *state, BINKD_CONFIG *config)
      * depends on the datestamp. */
     if (config->set_file_dates)
     {
-      if (touch (tmp_name, file->time) != 0)
+      if (touch (tmp_name, ftime) != 0)
         Log (1, "touch %s: %s", tmp_name, strerror (errno));
     }
 
@@ -576,7 +1096,6 @@ int inb_done (TFILE *file, STATE *state, BINKD_CONFIG *config)
       {
         Log (1, "cannot rename %s to it's realname: %s! (data stored in %s)",
              netname, strerror (errno), tmp_name);
-        *real_name = 0;
         return 0;
       }
       Log (2, "error renaming `%s' to `%s': %s",
@@ -587,7 +1106,7 @@ int inb_done (TFILE *file, STATE *state, BINKD_CONFIG *config)
         if (ren_style == RENAME_EXTENSION)
         {
           ren_style = RENAME_POSTFIX;
-          strnzcpy (real_name, state->inbound, MAXPATHLEN);
+          strnzcpy (real_name, inbound, MAXPATHLEN);
           strnzcat (real_name, PATH_SEPARATOR, MAXPATHLEN);
           s = real_name + strlen (real_name);
           strnzcat (real_name, u = makeinboundcase (strdequote (netname), (int)config->inboundcase), MAXPATHLEN);
@@ -597,16 +1116,220 @@ int inb_done (TFILE *file, STATE *state, BINKD_CONFIG *config)
         }
         Log (1, "cannot rename %s to it's realname! (data stored in %s)",
              netname, tmp_name);
-        *real_name = 0;
         return 0;
       }
     }
     Log (5, "%s -> %s", netname, real_name);
   }
+  return 1;
+}
+
+/*
+ * Duplicate index (dup-window). inb_test() only finds a file that is
+ * still in the inbound: once the tosser has taken it, the next uplink
+ * with the same file echo is downloaded again in full. The index keeps
+ * what each inbound (secure, non-secure) got in the last dup-window
+ * seconds -- name, size, date, and the CRC-32 taken in recv_block() as
+ * the data came in. start_file_recv() answers a file it lists before
+ * any data is sent; inb_done() drops a file that has the name, size
+ * and CRC of one already received with another date. In memory, the
+ * last DUP_MAX files.
+ *
+ * File requests are left out: the same .req from the same node within
+ * the window is a new request, and a binkp/1.0 remote waits for our
+ * answer to it (delay_EOB).
+ */
+#define DUP_MAX 512
+
+struct dup_entry
+{
+  char *netname;                       /* NULL: free */
+  boff_t size;
+  time_t time;
+  time_t when;                         /* received at */
+  unsigned long crc;
+  int crc_ok;
+  int secure;
+  FTN_ADDR fa;                         /* from */
+};
+
+#if defined(HAVE_THREADS) || defined(AMIGA)
+static MUTEXSEM dupsem;
+#endif
+static struct dup_entry *dups;
+static int dup_next;
+
+static void dup_init (void)
+{
+  InitSem (&dupsem);
+}
+
+static int dup_wanted (char *netname, BINKD_CONFIG *config)
+{
+  return config->dup_window > 0 && !isreq (netname);
+}
+
+/*
+ * The entry for file received into this inbound within the window:
+ * same name, size and date -- or, bycrc, same name, size and data.
+ * Under dupsem.
+ */
+static struct dup_entry *dup_find (TFILE *file, int secure, int bycrc,
+                                   time_t now, BINKD_CONFIG *config)
+{
+  struct dup_entry *d;
+  int i;
+
+  if (dups == NULL)
+    return NULL;
+  for (i = 0; i < DUP_MAX; i++)
+  {
+    d = dups + i;
+    if (d->netname == NULL || d->secure != secure || d->size != file->size ||
+        now - d->when >= config->dup_window || now < d->when)
+      continue;
+    if (bycrc ? (!d->crc_ok || d->crc != file->crc)
+              : (d->time & ~1) != (file->time & ~1))
+      continue;
+    if (!strcmp (d->netname, file->netname))
+      return d;
+  }
+  return NULL;
+}
+
+int inb_dup_test (STATE *state, BINKD_CONFIG *config)
+{
+  struct dup_entry *d;
+  char from[FTN_ADDR_SZ + 1];
+
+  if (!dup_wanted (state->in.netname, config))
+    return 0;
+  LockSem (&dupsem);
+  if ((d = dup_find (&state->in, state->state == P_SECURE, 0, time (0), config)) != NULL)
+    ftnaddress_to_str (from, &d->fa);
+  ReleaseSem (&dupsem);
+  if (d == NULL)
+    return 0;
+  Log (2, "already received %s (%" PRIuMAX " byte(s)) from %s",
+       state->in.netname, (uintmax_t) state->in.size, from);
+  return 1;
+}
+
+/*
+ * 1 -- file has the data of one received before under another date
+ * (logged)
+ */
+static int dup_content (TFILE *file, STATE *state, BINKD_CONFIG *config)
+{
+  struct dup_entry *d;
+  char from[FTN_ADDR_SZ + 1];
+
+  if (!dup_wanted (file->netname, config) || !file->crc_ok)
+    return 0;
+  LockSem (&dupsem);
+  if ((d = dup_find (file, state->state == P_SECURE, 1, time (0), config)) != NULL)
+    ftnaddress_to_str (from, &d->fa);
+  ReleaseSem (&dupsem);
+  if (d == NULL)
+    return 0;
+  Log (2, "%s (%" PRIuMAX " byte(s)): same data as received from %s, dropped",
+       file->netname, (uintmax_t) file->size, from);
+  return 1;
+}
+
+static void dup_add (TFILE *file, STATE *state, BINKD_CONFIG *config)
+{
+  struct dup_entry *d;
+  char *netname;
+
+  if (!dup_wanted (file->netname, config))
+    return;
+  netname = xstrdup (file->netname);
+  LockSem (&dupsem);
+  if (dups == NULL)
+  {
+    dups = xalloc (DUP_MAX * sizeof (*dups));
+    memset (dups, 0, DUP_MAX * sizeof (*dups));
+  }
+  d = dups + dup_next;
+  dup_next = (dup_next + 1) % DUP_MAX;
+  xfree (d->netname);
+  d->netname = netname;
+  d->size = file->size;
+  d->time = file->time;
+  d->when = time (0);
+  d->crc = file->crc;
+  d->crc_ok = file->crc_ok;
+  d->secure = state->state == P_SECURE;
+  memcpy (&d->fa, state->fa, sizeof (FTN_ADDR));
+  ReleaseSem (&dupsem);
+}
+
+/*
+ * File is complete, rename it to it's realname. 1=ok, 0=failed.
+ */
+int inb_done (TFILE *file, STATE *state, BINKD_CONFIG *config)
+{
+  char tmp_name[MAXPATHLEN + 1];
+  char real_name[MAXPATHLEN + 10];
+  char szAddr[FTN_ADDR_SZ + 1];
+  char *s, *u, *netname;
+
+  *real_name = 0;
+  netname = file->netname;
+  FR (state->fr, FR_INB_DONE, file->size, 0);
+
+  if (find_tmp_name (tmp_name, file, state, config) != 1)
+  {
+    Log (1, "missing tmp file for %s!", netname);
+    return 0;
+  }
+
+
+  strnzcpy (real_name, state->inbound, MAXPATHLEN);
+  strnzcat (real_name, PATH_SEPARATOR, MAXPATHLEN);
+  s = real_name + strlen (real_name);
+  strnzcat (real_name, u = makeinboundcase (strdequote (netname), (int)config->inboundcase), MAXPATHLEN);
+  free (u);
+  strwipe (s);
+
+#ifdef WITH_PERL
+  if (perl_after_recv(state, file, tmp_name, real_name)) {
+    /* Replacing .dt with .hr and removing temp. file */
+    if (access(tmp_name, 0) == 0) delete_later (tmp_name);
+    strcpy (strrchr (tmp_name, '.'), ".hr");
+    partial_drop (tmp_name);
+    delete_later (tmp_name);
+    return 1;
+  }
+#endif
+
+  if (dup_content (file, state, config))
+  {
+    strcpy (strrchr (tmp_name, '.'), ".hr");
+    partial_drop (tmp_name);
+    remove_hr (tmp_name);
+    return 1;
+  }
+
+  /* check pkt file header */
+  if (ispkt (netname))
+    check_pkthdr(state, file, tmp_name, real_name, config);
+
+  FR (state->fr, FR_INB_RENAME, 0, 0);
+  if (!inb_rename (tmp_name, real_name, netname, state->inbound, file->time, config))
+  {
+    FR (state->fr, FR_INB_RENAMED, 0, 0);
+    *real_name = 0;
+    return 0;
+  }
+  FR (state->fr, FR_INB_RENAMED, 1, 0);
 
   /* Replacing .dt with .hr and removing temp. file */
   strcpy (strrchr (tmp_name, '.'), ".hr");
-  sdelete (tmp_name);
+  partial_drop (tmp_name);
+  delete_later (tmp_name);
+  dup_add (file, state, config);
 
   if (*real_name)
   {
@@ -17,12 +17,35 @@ int inb_test (char *filename, boff_t size, time_t t,
  */
 FILE *inb_fopen (STATE *state, BINKD_CONFIG *config);
 
+/*
+ * prealloc-inbound: sizes a new preallocated file (state->in) once its
+ * offset is agreed. -1 -- the file is lost (state->in.f is NULL)
+ */
+int inb_prealloc (STATE *state);
+
+/*
+ * The receiving of a preallocated file (prealloc-inbound) has ended
+ * with have bytes of it: cut the .dt back, mark the .hr as usual.
+ */
+void inb_prealloc_end (STATE *state, TFILE *file, boff_t have, BINKD_CONFIG *config);
+
 /*
  * File is complete, rename it to it's realname. 1=ok, 0=failed.
  * Sets realname[MAXPATHLEN]
  */
 int inb_done (TFILE *file, STATE *state, BINKD_CONFIG *config);
 
+/*
+ * Checks the header of a received .pkt against the session akas
+ * (check-pkthdr). 1 -- ok or no check, 2 -- bad.
+ */
+int inb_pkthdr (STATE *state, unsigned char *buf, char *netname, BINKD_CONFIG *config);
+
+/*
+ * dup-window: 1 if state->in was received lately (logged)
+ */
+int inb_dup_test (STATE *state, BINKD_CONFIG *config);
+
 /*
  * Remove partial file
  */
@@ -33,4 +56,11 @@ int inb_reject (STATE *state, BINKD_CONFIG *config);
  */
 void inb_remove_partial (STATE *state, BINKD_CONFIG *config);
 
+/*
+ * The partial file index (inbound.c): init once, sweep from the
+ * manager loops.
+ */
+void inb_init (void);
+void inb_sweep_partials (BINKD_CONFIG *config);
+
 #endif
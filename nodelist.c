@@ -0,0 +1,403 @@
+/*
+ *  nodelist.c -- compiled nodelist index (IBN/INA hosts)
+ *
+ *  nodelist.c is a part of binkd project
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version. See COPYING.
+ */
+
+/*
+ * A node that is not in the config used to be reachable only through
+ * defnode, i.e. "*" and DNS, even though the sysop keeps a nodelist that
+ * says exactly where it answers (IBN, INA). The nodelist is far too big
+ * to parse at each call, so it is compiled once into "<nodelist>.bix":
+ * the binkp-capable nodes, sorted by address, each with an offset into a
+ * table of "host:port" strings. The index is rebuilt whenever the
+ * nodelist's datestamp or size no longer match the ones recorded in it;
+ * the nodelist is also put on the config file list, so a new nodelist
+ * reloads the config, which is what brings a new index in.
+ *
+ * There is no mmap() on AmigaOS, so the index is read into one block
+ * and looked up there with bsearch(); it is laid out so that a port with
+ * mmap() could use the file as it is. The .bix is a local cache in
+ * native byte order, not meant to be copied between machines.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "sys.h"
+#include "readcfg.h"
+#include "nodelist.h"
+#include "tools.h"
+
+#define NL_MAGIC "BNX1"
+
+struct nl_head
+{
+  char magic[4];
+  long src_mtime;                      /* the nodelist it was built from */
+  long src_size;
+  long count;                          /* records */
+  long strsize;                        /* bytes of host strings */
+};
+
+struct nl_rec
+{
+  unsigned short z, net, node, pad;
+  unsigned long host;                  /* offset into the string table */
+};
+
+struct nl_index
+{
+  struct nl_head h;
+  struct nl_rec *rec;                  /* both point into this block */
+  char *str;
+};
+
+/* an index under construction */
+struct nl_build
+{
+  struct nl_rec *rec;
+  long count, alloc;
+  char *str;
+  long strsize, stralloc;
+};
+
+static int nl_rec_cmp (const void *a, const void *b)
+{
+  const struct nl_rec *ra = a, *rb = b;
+
+  if (ra->z != rb->z)
+    return ra->z < rb->z ? -1 : 1;
+  if (ra->net != rb->net)
+    return ra->net < rb->net ? -1 : 1;
+  if (ra->node != rb->node)
+    return ra->node < rb->node ? -1 : 1;
+  return 0;
+}
+
+/*
+ * Returns the n-th (0...) comma separated field of a nodelist line, or
+ * NULL. The field ends at the next comma or at the end of the string.
+ */
+static char *nl_field (char *s, int n)
+{
+  for (; n > 0; n--)
+    if ((s = strchr (s, ',')) == NULL)
+      return NULL;
+    else
+      s++;
+  return s;
+}
+
+static int nl_fieldlen (const char *s)
+{
+  const char *e = strchr (s, ',');
+
+  return e ? (int) (e - s) : (int) strlen (s);
+}
+
+static int nl_isnum (const char *s, int len)
+{
+  int i;
+
+  for (i = 0; i < len; i++)
+    if (!isdigit ((unsigned char) s[i]))
+      return 0;
+  return len > 0;
+}
+
+static int nl_keyword (const char *s, int len, const char *kw)
+{
+  return len == (int) strlen (kw) && !STRNICMP (s, kw, len);
+}
+
+/*
+ * Builds "host:port" for one node from its flags (field 7 and on):
+ *   IBN, IBN:port, IBN:host, IBN:host:port  -- binkp, the host wins
+ *   INA:host                                -- default host for IBN
+ * A node without IBN does not talk binkp and is not indexed (0).
+ * No host at all gives "*", which get_host_and_port() expands.
+ */
+static int nl_hosts (char *flags, char *hosts, int size)
+{
+  char ibn_host[BINKD_FQDNLEN + 1], ina_host[BINKD_FQDNLEN + 1];
+  char port[MAXSERVNAME + 1];
+  int ibn = 0;
+  char *f;
+
+  ibn_host[0] = ina_host[0] = port[0] = 0;
+  for (f = flags; f; f = nl_field (f, 1))
+  {
+    int len = nl_fieldlen (f);
+
+    if (len >= 3 && !STRNICMP (f, "IBN", 3) && (len == 3 || f[3] == ':'))
+    {
+      char *a = f + 4, *b;
+      int alen, blen;
+
+      ibn = 1;
+      if (len <= 4)
+        continue;
+      alen = len - 4;
+      if ((b = memchr (a, ':', alen)) != NULL)
+      {
+        blen = alen - (int) (b - a) - 1;
+        alen = (int) (b - a);
+        b++;
+      }
+      else
+        blen = 0;
+      if (nl_isnum (a, alen))           /* IBN:port */
+      {
+        if (alen <= MAXSERVNAME)
+          memcpy (port, a, alen), port[alen] = 0;
+      }
+      else if (alen > 0 && alen <= BINKD_FQDNLEN)
+      {
+        memcpy (ibn_host, a, alen), ibn_host[alen] = 0;
+        if (nl_isnum (b, blen) && blen <= MAXSERVNAME)
+          memcpy (port, b, blen), port[blen] = 0;
+      }
+    }
+    else if (len > 4 && !STRNICMP (f, "INA:", 4) && !ina_host[0] &&
+             len - 4 <= BINKD_FQDNLEN)
+    {
+      memcpy (ina_host, f + 4, len - 4);
+      ina_host[len - 4] = 0;
+    }
+  }
+  if (!ibn)
+    return 0;
+  snprintf (hosts, size, "%s%s%s",
+            ibn_host[0] ? ibn_host : ina_host[0] ? ina_host : "*",
+            port[0] ? ":" : "", port);
+  return 1;
+}
+
+static void nl_add (struct nl_build *b, int z, int net, int node, char *hosts)
+{
+  int len = (int) strlen (hosts) + 1;
+
+  if (b->count >= b->alloc)
+  {
+    b->alloc = b->alloc ? b->alloc * 2 : 1024;
+    b->rec = xrealloc (b->rec, b->alloc * sizeof (struct nl_rec));
+  }
+  if (b->strsize + len > b->stralloc)
+  {
+    b->stralloc = b->stralloc ? b->stralloc * 2 : 16384;
+    b->str = xrealloc (b->str, b->stralloc);
+  }
+  memcpy (b->str + b->strsize, hosts, len);
+  b->rec[b->count].host = b->strsize;
+  b->strsize += len;
+  b->rec[b->count].z = (unsigned short) z;
+  b->rec[b->count].net = (unsigned short) net;
+  b->rec[b->count].node = (unsigned short) node;
+  b->rec[b->count].pad = 0;
+  b->count++;
+}
+
+/*
+ * Parses the nodelist into b. Zone/Region/Host lines open a net (and are
+ * node 0 of it), Hub/Pvt/Hold and unkeyworded lines are nodes in it, and
+ * Down nodes are left out. Nodediffs are not applied here: binkd indexes
+ * whatever nodelist the usual nodelist processor has produced.
+ */
+static int nl_parse (char *path, struct nl_build *b)
+{
+  char buf[MAXCFGLINE + 1], hosts[BINKD_FQDNLEN + MAXSERVNAME + 2];
+  int z = -1, net = -1, node;
+  FILE *f;
+
+  if ((f = fopen (path, "r")) == NULL)
+  {
+    Log (1, "cannot open nodelist %s: %s", path, strerror (errno));
+    return 0;
+  }
+  while (fgets (buf, sizeof (buf), f))
+  {
+    char *kw = buf, *num, *flags, *p;
+    int kwlen, n;
+
+    if ((p = strpbrk (buf, "\r\n\x1a")) != NULL)
+      *p = 0;
+    if (*buf == ';' || *buf == 0)
+      continue;
+    if ((num = nl_field (buf, 1)) == NULL || !nl_isnum (num, nl_fieldlen (num)))
+      continue;
+    n = atoi (num);
+    kwlen = nl_fieldlen (kw);
+    if (nl_keyword (kw, kwlen, "Zone"))
+      z = net = n, node = 0;
+    else if (nl_keyword (kw, kwlen, "Region") || nl_keyword (kw, kwlen, "Host"))
+      net = n, node = 0;
+    else if (kwlen == 0 || nl_keyword (kw, kwlen, "Hub") ||
+             nl_keyword (kw, kwlen, "Pvt") || nl_keyword (kw, kwlen, "Hold"))
+      node = n;
+    else                                /* Down, Boss, Point, ... */
+      continue;
+    if (z < 0 || (flags = nl_field (buf, 7)) == NULL)
+      continue;
+    if (nl_hosts (flags, hosts, sizeof (hosts)))
+      nl_add (b, z, net, node, hosts);
+  }
+  fclose (f);
+  return 1;
+}
+
+static struct nl_index *nl_alloc (long count, long strsize)
+{
+  struct nl_index *idx;
+
+  idx = xalloc (sizeof (*idx) + count * sizeof (struct nl_rec) + strsize + 1);
+  idx->rec = (struct nl_rec *) (idx + 1);
+  idx->str = (char *) (idx->rec + count);
+  idx->str[strsize] = 0;
+  idx->h.count = count;
+  idx->h.strsize = strsize;
+  return idx;
+}
+
+static struct nl_index *nl_read (char *path, struct stat *sb)
+{
+  struct nl_head h;
+  struct nl_index *idx;
+  FILE *f;
+  int ok;
+
+  if ((f = fopen (path, "rb")) == NULL)
+    return NULL;
+  if (fread (&h, sizeof (h), 1, f) != 1 || memcmp (h.magic, NL_MAGIC, 4) ||
+      h.src_mtime != (long) sb->st_mtime || h.src_size != (long) sb->st_size ||
+      h.count < 0 || h.strsize < 0)
+  {
+    fclose (f);
+    return NULL;
+  }
+  idx = nl_alloc (h.count, h.strsize);
+  memcpy (&idx->h, &h, sizeof (h));
+  ok = (h.count == 0 ||
+        fread (idx->rec, sizeof (struct nl_rec), h.count, f) == (size_t) h.count) &&
+       (h.strsize == 0 || fread (idx->str, h.strsize, 1, f) == 1);
+  fclose (f);
+  if (!ok)
+  {
+    free (idx);
+    return NULL;
+  }
+  return idx;
+}
+
+static void nl_write (char *path, struct nl_index *idx)
+{
+  char tmp[MAXPATHLEN + 1];
+  FILE *f;
+  int ok;
+
+  strnzcpy (tmp, path, sizeof (tmp) - 4);
+  strcat (tmp, ".tmp");
+  if ((f = fopen (tmp, "wb")) == NULL)
+  {
+    Log (2, "cannot write nodelist index %s: %s", tmp, strerror (errno));
+    return;
+  }
+  ok = fwrite (&idx->h, sizeof (idx->h), 1, f) == 1 &&
+       (idx->h.count == 0 ||
+        fwrite (idx->rec, sizeof (struct nl_rec), idx->h.count, f) == (size_t) idx->h.count) &&
+       (idx->h.strsize == 0 || fwrite (idx->str, idx->h.strsize, 1, f) == 1);
+  if (fclose (f) != 0)
+    ok = 0;
+  /* AmigaDOS Rename() does not replace an existing file */
+  if (ok)
+  {
+    UNLINK (path);
+    ok = (RENAME (tmp, path) == 0);
+  }
+  if (!ok)
+  {
+    Log (2, "cannot write nodelist index %s: %s", path, strerror (errno));
+    UNLINK (tmp);
+  }
+}
+
+int nodelist_open (struct nodelistchain *nl)
+{
+  char ipath[MAXPATHLEN + 1];
+  struct stat sb;
+  struct nl_build b;
+  long i;
+
+  if (stat (nl->path, &sb) != 0)
+  {
+    Log (1, "nodelist %s: %s", nl->path, strerror (errno));
+    return 0;
+  }
+  strnzcpy (ipath, nl->path, sizeof (ipath) - 4);
+  strcat (ipath, ".bix");
+  if ((nl->idx = nl_read (ipath, &sb)) != NULL)
+  {
+    Log (4, "nodelist %s: %ld binkp nodes (index %s)", nl->path, nl->idx->h.count, ipath);
+    return 1;
+  }
+
+  Log (3, "compiling nodelist %s", nl->path);
+  memset (&b, 0, sizeof (b));
+  if (!nl_parse (nl->path, &b))
+  {
+    xfree (b.rec);
+    xfree (b.str);
+    return 0;
+  }
+  qsort (b.rec, b.count, sizeof (struct nl_rec), nl_rec_cmp);
+  nl->idx = nl_alloc (b.count, b.strsize);
+  memcpy (nl->idx->h.magic, NL_MAGIC, 4);
+  nl->idx->h.src_mtime = (long) sb.st_mtime;
+  nl->idx->h.src_size = (long) sb.st_size;
+  for (i = 0; i < b.count; i++)
+    nl->idx->rec[i] = b.rec[i];
+  if (b.strsize)
+    memcpy (nl->idx->str, b.str, b.strsize);
+  xfree (b.rec);
+  xfree (b.str);
+  nl_write (ipath, nl->idx);
+  Log (4, "nodelist %s: %ld binkp nodes", nl->path, nl->idx->h.count);
+  return 1;
+}
+
+void nodelist_close (struct nodelistchain *nl)
+{
+  xfree (nl->idx);
+}
+
+int nodelist_lookup (FTN_ADDR *fa, char *hosts, int size, struct nodelistchain *nl)
+{
+  struct nl_rec key, *r;
+
+  if (fa->p != 0 || fa->z < 0 || fa->net < 0 || fa->node < 0)
+    return 0;
+  memset (&key, 0, sizeof (key));
+  key.z = (unsigned short) fa->z;
+  key.net = (unsigned short) fa->net;
+  key.node = (unsigned short) fa->node;
+  for (; nl; nl = nl->next)
+  {
+    if (!nl->idx || STRICMP (nl->domain, fa->domain))
+      continue;
+    r = bsearch (&key, nl->idx->rec, nl->idx->h.count, sizeof (struct nl_rec), nl_rec_cmp);
+    if (r && r->host < (unsigned long) nl->idx->h.strsize)
+    {
+      strnzcpy (hosts, nl->idx->str + r->host, size);
+      return 1;
+    }
+  }
+  return 0;
+}
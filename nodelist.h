@@ -0,0 +1,45 @@
+/*
+ *  nodelist.h -- compiled nodelist index (IBN/INA hosts)
+ *
+ *  nodelist.h is a part of binkd project
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version. See COPYING.
+ */
+
+#ifndef _nodelist_h
+#define _nodelist_h
+
+#include "btypes.h"
+
+struct nl_index;
+
+/* val: struct for nodelist */
+struct nodelistchain
+{
+  struct nodelistchain *next;
+  char *path;                          /* the nodelist itself */
+  char domain[MAX_DOMAIN + 1];
+  struct nl_index *idx;                /* loaded "<path>.bix", read-only */
+};
+
+/*
+ * Loads nl->idx from "<path>.bix", rebuilding that file from the
+ * nodelist first if it is missing or older. 0 == error (logged).
+ */
+int nodelist_open (struct nodelistchain *nl);
+
+/*
+ * Frees nl->idx
+ */
+void nodelist_close (struct nodelistchain *nl);
+
+/*
+ * Looks fa up in the nodelists and writes its "host:port" to hosts
+ * (at least BINKD_FQDNLEN + 1 bytes). 0 == not listed with IBN.
+ */
+int nodelist_lookup (FTN_ADDR *fa, char *hosts, int size, struct nodelistchain *nl);
+
+#endif
@@ -84,7 +84,7 @@ void process_killlist (KILLLIST *killlist, int n_killlist, int flag)
   Log (6, "processing kill list");
   for (i = 0; i < n_killlist; ++i)
     if (killlist[i].cond != 's' || (flag == 's' && killlist[i].cond == 's'))
-      delete (killlist[i].name);
+      delete_later (killlist[i].name);
 }
 
 /* Adds a file to rcvdlist */
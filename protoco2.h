@@ -17,6 +17,7 @@
 
 #include "btypes.h"
 #include "iphdr.h"
+#include "flight.h"
 
 #define BLK_HDR_SIZE 2
 
@@ -61,13 +62,7 @@ struct _BW
 typedef struct _STATE STATE;
 struct _STATE
 {
-#ifdef DIAG_HS
-  /* v10.21 diag5 handshake-breadcrumb budget.  Lives in STATE, not in a
-   * static, for the same reason DIAG_SPIN/DIAG_SEL use locals: session
-   * Processes share one address space on this port, so a static would let
-   * concurrent sessions drain each other's budget. */
-  int diag_hs_left;
-#endif
+  FLIGHT *fr;                   /* this session's event ring, may be NULL */
   SOCKET s_in, s_out;
   struct _BINKD_CONFIG *config;
   FTN_NODE *to;			/* Dest. address (if an outbound connection) */
@@ -93,6 +88,8 @@ struct _STATE
   TFILE *sent_fls;		/* Sent files: waiting for GOT */
   int n_sent_fls;		/* The number of... */
   FTNQ *q;			/* Queue */
+  FTNQ *q_cursor;		/* Last entry select_next_file() gave out,
+				 * NULL = start again from the head of q */
   FTN_ADDR *fa;			/* Foreign akas */
   FTN_ADDR *remote_fa;		/* Remote AKA given from command-line */
   int nfa;			/* How many... */
@@ -103,6 +100,8 @@ struct _STATE
   int skip_all_flag;		/* We'd skip all */
   int r_skipped_flag;		/* Remote skipped smthng */
   int listed_flag;              /* Listed? */
+  int pkthdr_check;             /* check-pkthdr applies? 0: not decided,
+                                 * 1: yes, 2: no */
   char *inbound;		/* The current inbound dir */
   char *peer_name;              /* Remote host's name */
   char *ipaddr;			/* Remote IP */
@@ -142,6 +141,8 @@ struct _STATE
   int waiting_for_GOT;          /* File sent, waiting for M_GOT in ND-mode */
   int send_eof;			/* Need to send zero-length data block */
   TFILE in_complete;            /* M_GOT sent, need to rename */
+  TFILE *to_commit;             /* commit-batch: M_GOT sent, renamed at */
+  int n_to_commit;              /* M_EOB or when there are enough */
   FTN_ADDR ND_addr;             /* Address for current ND status */
   int crypt_flag;		/* Is session encrypted? */
   unsigned long keys_out[3];	/* Encription keys for outbound */
@@ -11,6 +11,8 @@
  *  (at your option) any later version. See COPYING.
  */
 
+#define LOG_SUBSYS protocol  /* loglevel-protocol, see tools.h */
+
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -128,42 +130,6 @@ static void diag_out_path (STATE *state, const char *src, const void *ctx)
 #define DIAG_OUT_PATH(s,src,ctx) do { } while (0)
 #endif
 
-#ifdef DIAG_HS
-/* v10.21 "diag5": breadcrumbs through the connect -> handshake window.
- *
- * The 2026-08-16 14:00 poll hung for 67 minutes between client.c's
- * "connected" and protocol.c's "pwd protected session".  It had completed
- * the full outbound scan and two of three sessions; the third connected at
- * TCP level and then stopped, never writing END, and the two following
- * scheduled polls never ran.  DIAG_SEL was silent, so it was NOT inside
- * SELECT(); DIAG_SPIN was silent, so it was not spinning.  On AMIGA the
- * only SELECT() compiled in is the DIAG_SEL-wrapped one (the other sits
- * under #ifdef WIN32), so select really is excluded.
- *
- * That leaves init_protocol(), banner(), and the raw send()/recv() calls -
- * all of which currently log only at level 7/9, i.e. invisible at the
- * deployed loglevel 3.  So this logs each step at level 2 instead.  A hang
- * produces no further output, so the LAST breadcrumb names the blocking
- * call directly rather than by elimination.
- *
- * Self-limiting: HS_RESET() re-arms a fixed budget per protocol() entry, so
- * an established long session cannot flood the log the way a raw level-7
- * build would.  Remove the whole -DDIAG_HS flag once the call is named.
- *
- * The budget lives in STATE (see protoco2.h), not in a static: session
- * Processes share one address space here, so a static would let concurrent
- * sessions drain each other's count.
- */
-#define HS_RESET() (state->diag_hs_left = 150)
-#define HS(fmt, ...) do { if (state->diag_hs_left > 0) \
-                          { --state->diag_hs_left; \
-                            Log (2, "DIAG-HS: " fmt, ##__VA_ARGS__); } \
-                        } while (0)
-#else
-#define HS_RESET() do { } while (0)
-#define HS(fmt, ...) do { } while (0)
-#endif
-
 /*
  * Fills <<state>> with initial values, allocates buffers, etc.
  */
@@ -173,9 +139,7 @@ static int init_protocol (STATE *state, SOCKET socket_in, SOCKET socket_out, FTN
   socklen_t lval;
 
   memset (state, 0, sizeof (STATE));
-  /* after the memset, which would otherwise zero the budget we just set */
-  HS_RESET ();
-  HS ("init_protocol: entry");
+  state->fr = flight_self ();
 
   state->major = 1;
   state->minor = 0;
@@ -251,7 +215,7 @@ static int init_protocol (STATE *state, SOCKET socket_in, SOCKET socket_out, FTN
   {
     Log (6, "binkp init done, socket # is %i", state->s_in);
   }
-  HS ("init_protocol: done");
+  FR (state->fr, FR_INIT, 0, 0);
   return 1;
 }
 
@@ -292,11 +256,35 @@ static int close_partial (STATE *state, BINKD_CONFIG *config)
     state->in.f = NULL;
     if (s == 0)
       inb_reject (state, config);
+    else
+      inb_prealloc_end (state, &state->in, s, config);
   }
   TF_ZERO (&state->in);
   return 0;
 }
 
+/*
+ * commit-batch: renames the files received since the last commit. They
+ * are already closed and acknowledged, so this is only the directory
+ * work inb_done() does, done for a batch at a time: at M_EOB, every
+ * commit-batch files and at the end of the session. 0 -- failed, the
+ * rest is left for partial_recover() (inbound.c).
+ */
+static int commit_received (STATE *state, BINKD_CONFIG *config)
+{
+  int i, n = state->n_to_commit;
+
+  state->n_to_commit = 0;
+  for (i = 0; i < n; i++)
+    if (inb_done (state->to_commit + i, state, config) == 0)
+    {
+      Log (1, "commit of %d received file(s) stopped at %s", n - i,
+           state->to_commit[i].netname);
+      return 0;
+    }
+  return 1;
+}
+
 /*
  * Clears protocol buffers and queues, closes files, etc.
  */
@@ -305,6 +293,8 @@ static int deinit_protocol (STATE *state, BINKD_CONFIG *config, int status)
   int i;
 
   close_partial(state, config);
+  commit_received (state, config);
+  xfree (state->to_commit);
   if (state->out.f)
     fclose (state->out.f);
   if (state->flo.f)
@@ -335,6 +325,7 @@ static int deinit_protocol (STATE *state, BINKD_CONFIG *config, int status)
 
   if (state->q)
     q_free (state->q, config);
+  state->q_cursor = NULL;
   xfree (state->fa);
   xfree (state->pAddr);
   xfree (state->MD_challenge);
@@ -443,14 +434,13 @@ static int send_block (STATE *state, BINKD_CONFIG *config)
   if (state->optr && state->oleft)
   {
     Log (7, "sending %i byte(s)", state->oleft);
-    HS ("send_block: about to %s %i byte(s)",
-        state->pipe ? "write()" : "send()", state->oleft);
+    FR (state->fr, FR_SEND, state->oleft, 0);
     if (state->pipe)
       /* TODO: this call should be non-blocking on WIN32 */
       n = write (state->s_out, state->optr, state->oleft);
     else
       n = send (state->s_out, state->optr, state->oleft, MSG_NOSIGNAL);
-    HS ("send_block: %s returned %i", state->pipe ? "write()" : "send()", n);
+    FR (state->fr, FR_SENT, n, 0);
 #ifdef BW_LIM
     state->bw_send.bytes += n;
 #endif
@@ -478,6 +468,7 @@ static int send_block (STATE *state, BINKD_CONFIG *config)
           (state->pipe != 0 && save_errno != EWOULDBLOCK && errno != EAGAIN))
       {
         state->io_error = 1;
+        FR (state->fr, FR_ERROR, save_errno, 0);
         if (!binkd_exit)
         {
           Log (1, "%s: %s", state->pipe ? "write" : "send", save_err);
@@ -1438,7 +1429,7 @@ static int ADR (STATE *state, char *s, int sz, BINKD_CONFIG *config)
     }
 #endif
 
-    if (pn) state->listed_flag |= pn->listed;
+    if (pn) state->listed_flag |= pn->listed & NL_LISTED;
     if (state->expected_pwd[0] && pn)
     {
       char *pwd = state->to ? pn->out_pwd : pn->pwd;
@@ -1502,7 +1493,7 @@ static int ADR (STATE *state, char *s, int sz, BINKD_CONFIG *config)
         main_AKA_ok = 1;
       }
 #ifdef BW_LIM
-      if (pn && pn->listed) {
+      if (pn && (pn->listed & NL_LISTED)) {
         if (pn->bw_send == 0) bw_send_unlim = 1;
         else if (pn->bw_send < 0
                  && (!state->bw_send.rel
@@ -1685,15 +1676,19 @@ static int complete_login (STATE *state, BINKD_CONFIG *config)
   if (OK_SEND_FILES (state, config) && state->q == NULL)
     state->q = q_scan_addrs (0, state->fa, state->nfa, state->to ? 1 : 0, config);
   if (OK_SEND_FILES (state, config))
+  {
     state->q = q_sort (state->q, state->fa, state->nfa, config);
+    state->q_cursor = NULL;
+  }
   state->msgs_in_batch = 0;               /* Forget about login msgs */
-  /* Handshake is over: this is the far side of the window the 2026-08-16
-   * stall died inside, so stop spending breadcrumbs on the established
-   * session. */
-  HS ("handshake complete, breadcrumbs off");
-#ifdef DIAG_HS
-  state->diag_hs_left = 0;
-#endif
+  FR (state->fr, FR_HANDSHAKE, state->nfa, state->state);
+  if (state->fr && state->nfa)
+  {
+    char szAddr[FTN_ADDR_SZ + 1];
+
+    ftnaddress_to_str (szAddr, state->fa);
+    flight_name (state->fr, szAddr);
+  }
   if (state->state == P_SECURE)
     Log (2, "pwd protected session (%s)",
          (state->MD_flag == 1) ? "MD5" : "plain text");
@@ -2126,6 +2121,15 @@ static int start_file_recv (STATE *state, char *args, int sz, BINKD_CONFIG *conf
                    (uintmax_t) state->in.time);
         return 1;
       }
+      else if (inb_dup_test (state, config))
+      {
+        msg_sendf (state, (t_msg)(config->dup_skip ? M_SKIP : M_GOT),
+                   "%s %" PRIuMAX " %" PRIuMAX,
+                   state->in.netname,
+                   (uintmax_t) state->in.size,
+                   (uintmax_t) state->in.time);
+        return 1;
+      }
       else if (!state->skip_all_flag)
       {
         if ((state->in.f = inb_fopen (state, config)) == 0)
@@ -2196,6 +2200,16 @@ static int start_file_recv (STATE *state, char *args, int sz, BINKD_CONFIG *conf
 
     Log (5, "receiving %s (%" PRIuMAX " byte(s), off %" PRIuMAX ")",
          state->in.netname, (uintmax_t) (state->in.size), (uintmax_t) offset);
+    if (inb_prealloc (state) != 0)
+    {
+      Log (2, "skipping %s (non-destructive)", state->in.netname);
+      msg_sendf (state, M_SKIP, "%s %" PRIuMAX " %" PRIuMAX,
+                 state->in.netname,
+                 (uintmax_t) state->in.size,
+                 (uintmax_t) state->in.time);
+      TF_ZERO (&state->in);
+      return 1;
+    }
 #ifdef BW_LIM
     setup_rate_limit(state, config, &state->bw_recv, state->in.netname);
 #endif
@@ -2237,8 +2251,12 @@ static int start_file_recv (STATE *state, char *args, int sz, BINKD_CONFIG *conf
       Log (1, "fseek: %s", strerror (errno));
       return 0;
     }
-    else
-      return 1;
+    /* a .pkt taken from its start: keep its header for check_pkthdr() */
+    state->in.npkthdr = (offset == 0 && ispkt (state->in.netname)) ? 0 : -1;
+    /* and for dup-window, its CRC */
+    state->in.crc = 0xFFFFFFFFUL;
+    state->in.crc_ok = (offset == 0 && config->dup_window > 0);
+    return 1;
   }
   else
     return 0;
@@ -2690,6 +2708,13 @@ static int EOB (STATE *state, char *buf, int sz, BINKD_CONFIG *config)
     }
     TF_ZERO (&state->in_complete);
   }
+  if (!commit_received (state, config))
+  {
+    msg_send2 (state, M_ERR, "Local error saving file", 0);
+    if (state->to)
+      bad_try (&state->to->fa, "Local error saving file", BAD_IO, config);
+    return 0; /* error, drop session */
+  }
   state->delay_EOB = 0; /* val: we can do it anyway now :) */
   return 1;
 }
@@ -2700,6 +2725,43 @@ static command *commands[] =
   NUL, ADR, PWD, start_file_recv, OK, EOB, GOT, RError, BSY, GET, SKIP
 };
 
+/*
+ * Keeps the first PKT_HDR_SIZE bytes of a .pkt as they arrive and has
+ * inb_pkthdr() judge them once complete, the way send_block() looks at
+ * the header of a .pkt going out. inb_done() then has the verdict
+ * without opening the file again.
+ */
+static void recv_pkthdr (STATE *state, char *buf, int n, BINKD_CONFIG *config)
+{
+  TFILE *f = &state->in;
+  int k;
+
+  if (f->npkthdr < 0 || f->npkthdr >= PKT_HDR_SIZE || n <= 0)
+    return;
+  k = PKT_HDR_SIZE - f->npkthdr;
+  if (k > n)
+    k = n;
+  memcpy (f->pkthdr + f->npkthdr, buf, k);
+  if ((f->npkthdr += k) == PKT_HDR_SIZE)
+    f->pkthdr_ok = inb_pkthdr (state, f->pkthdr, f->netname, config);
+}
+
+/*
+ * The CRC-32 of a file received from its start (dup-window), the same
+ * table-driven CRC as crypt.c: one table lookup per byte, which a 68000
+ * keeps up with at any line speed it can reach.
+ */
+static void recv_crc (STATE *state, char *buf, int n)
+{
+  unsigned long crc = state->in.crc;
+
+  if (!state->in.crc_ok)
+    return;
+  while (n-- > 0)
+    crc = CRC32 (crc, (unsigned char) *buf++);
+  state->in.crc = crc;
+}
+
 /* Recvs next block, processes msgs or writes down the data from the remote */
 static int recv_block (STATE *state, BINKD_CONFIG *config)
 {
@@ -2711,13 +2773,12 @@ static int recv_block (STATE *state, BINKD_CONFIG *config)
     no = 0;
   else
   {
-    HS ("recv_block: about to %s up to %i byte(s)",
-        state->pipe ? "read()" : "recv()", (int) (sz - state->iread));
+    FR (state->fr, FR_RECV, sz - state->iread, 0);
     if (state->pipe)
       no = read (state->s_in, state->ibuf + state->iread, sz - state->iread);
     else
       no = recv (state->s_in, state->ibuf + state->iread, sz - state->iread, 0);
-    HS ("recv_block: %s returned %i", state->pipe ? "read()" : "recv()", no);
+    FR (state->fr, FR_RECVD, no, 0);
     Log (9, "Read %i bytes", no);
     if (no == -1)
     {
@@ -2727,6 +2788,7 @@ static int recv_block (STATE *state, BINKD_CONFIG *config)
         return 1;
       if (!state->pipe && (TCPERRNO == TCPERR_WOULDBLOCK || TCPERRNO == TCPERR_AGAIN))
         return 1;
+      FR (state->fr, FR_ERROR, state->pipe ? errno : TCPERRNO, 1);
       save_err = state->pipe ? strerror(errno) : TCPERR();
       state->io_error = 1;
       if (!binkd_exit)
@@ -2777,6 +2839,7 @@ static int recv_block (STATE *state, BINKD_CONFIG *config)
         {
           state->ibuf[state->isize] = 0;
           Log (5, "rcvd msg %s %s", scommand[(unsigned char)(state->ibuf[0])], state->ibuf+1);
+          FR (state->fr, FR_MSG, state->ibuf[0], state->isize - 1);
           rc = commands[(unsigned) (state->ibuf[0])]
             (state, state->ibuf + 1, state->isize - 1, config);
         }
@@ -2818,6 +2881,8 @@ static int recv_block (STATE *state, BINKD_CONFIG *config)
             }
             else
               Log (10, "%d bytes of data decompressed to %d", nput, zavail);
+            recv_pkthdr (state, zbuf, zavail, config);
+            recv_crc (state, zbuf, zavail);
             if (zavail != 0 && fwrite (zbuf, zavail, 1, state->in.f) < 1)
             {
               Log (1, "write error: %s", strerror(errno));
@@ -2843,6 +2908,8 @@ static int recv_block (STATE *state, BINKD_CONFIG *config)
         }
         else
 #endif
+        recv_pkthdr (state, state->ibuf, state->isize, config);
+        recv_crc (state, state->ibuf, state->isize);
         if (state->isize != 0 &&
             (fwrite (state->ibuf, state->isize, 1, state->in.f) < 1 ||
             fflush (state->in.f)))
@@ -2888,6 +2955,13 @@ static int recv_block (STATE *state, BINKD_CONFIG *config)
                  state->in.netname);
             memcpy(&state->in_complete, &state->in, sizeof(state->in_complete));
           }
+          else if (config->commit_batch > 0)
+          {
+            inb_prealloc_end (state, &state->in, state->in.size, config);
+            state->to_commit = xrealloc (state->to_commit,
+                                 (state->n_to_commit + 1) * sizeof (TFILE));
+            memcpy (state->to_commit + state->n_to_commit++, &state->in, sizeof (TFILE));
+          }
           else
           {
             if (inb_done (&(state->in), state, config) == 0)
@@ -2903,6 +2977,14 @@ static int recv_block (STATE *state, BINKD_CONFIG *config)
                      (uintmax_t) state->in.size,
                      (uintmax_t) state->in.time);
           TF_ZERO (&state->in);
+          if (state->n_to_commit >= config->commit_batch &&
+              state->n_to_commit > 0 && !commit_received (state, config))
+          {
+            msg_send2 (state, M_ERR, "Local error saving file", 0);
+            if (state->to)
+              bad_try (&state->to->fa, "Local error saving file", BAD_IO, config);
+            return 0; /* error, drop session */
+          }
         }
         else if (ftello (state->in.f) > state->in.size)
         {
@@ -2947,7 +3029,7 @@ static int banner (STATE *state, BINKD_CONFIG *config)
   char *month[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
                    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
 
-  HS ("banner: entry (queueing initial M_NUL block)");
+  FR (state->fr, FR_BANNER, 0, 0);
   if (!no_MD5 && !state->to &&
       (state->MD_challenge = MD_getChallenge(NULL, state)) != NULL)
   {  /* Answering side MUST send CRAM message as a very first M_NUL */
@@ -3023,7 +3105,7 @@ static int banner (STATE *state, BINKD_CONFIG *config)
     msg_send2(state, M_NUL, "OPT", szOpt);
     xfree(szOpt);
   }
-  HS ("banner: done");
+  FR (state->fr, FR_BANNER, 1, 0);
   return 1;
 }
 
@@ -3237,17 +3319,6 @@ void protocol (SOCKET socket_in, SOCKET socket_out, FTN_NODE *to, FTN_ADDR *fa,
   struct timeval tv;
   fd_set r, w;
   int no, rd;
-#ifdef DIAG_SPIN
-  /* See the DIAG_SPIN block in the main loop. Locals, not statics -- session
-   * Processes share one address space on this port. */
-  unsigned long diag_sig = (unsigned long) -1, diag_idle = 0;
-  time_t diag_idle_since = 0, diag_last_report = 0;
-#endif
-#ifdef DIAG_SEL
-  /* Locals for the same reason. See the DIAG_SEL block around SELECT(). */
-  time_t diag_sel_t0 = 0;
-  long diag_sel_tv = 0;
-#endif
 #ifdef WIN32
   unsigned long t_out = 0;
   unsigned long u_nettimeout = config->nettimeout*1000000l;
@@ -3316,7 +3387,9 @@ void protocol (SOCKET socket_in, SOCKET socket_out, FTN_NODE *to, FTN_ADDR *fa,
      * does) have one session's failing call logged with another
      * session's unrelated errno, typically surfacing as a nonsensical
      * "getpeername: No error". */
+    FR (state.fr, FR_PEERNAME, 0, 0);
     LockSem (&peernamesem);
+    FR (state.fr, FR_PEERNAME, 1, 0);
     if ((status = getpeername (socket_in, (struct sockaddr *)&peer_name, &peer_name_len)) != 0)
     {
       if (!binkd_exit)
@@ -3390,7 +3463,10 @@ void protocol (SOCKET socket_in, SOCKET socket_out, FTN_NODE *to, FTN_ADDR *fa,
   /* v10.7: same peernamesem protection as the getpeername() call above -
    * getsockname()'s TCPERR() read is just as exposed to a sibling
    * session's errno clobbering it first. */
+  flight_name (state.fr, state.peer_name);
+  FR (state.fr, FR_PEERNAME, 0, 1);
   LockSem (&peernamesem);
+  FR (state.fr, FR_PEERNAME, 1, 1);
   if (state.pipe || getsockname (socket_in, (struct sockaddr *)&peer_name, &peer_name_len) == -1)
   {
     if (!state.pipe && !binkd_exit)
@@ -3432,7 +3508,7 @@ void protocol (SOCKET socket_in, SOCKET socket_out, FTN_NODE *to, FTN_ADDR *fa,
         {                               /* Next .pkt, .flo or a file */
           q = 0;
           if (state.flo.f ||
-              (q = select_next_file (state.q, state.fa, state.nfa)) != 0)
+              (q = select_next_file (state.q, &state.q_cursor)) != 0)
           {
             if (start_file_transfer (&state, q, config))
               break;
@@ -3441,6 +3517,7 @@ void protocol (SOCKET socket_in, SOCKET socket_out, FTN_NODE *to, FTN_ADDR *fa,
           {
             q_free (state.q, config);
             state.q = 0;
+            state.q_cursor = NULL;
             break;
           }
         }
@@ -3504,6 +3581,7 @@ void protocol (SOCKET socket_in, SOCKET socket_out, FTN_NODE *to, FTN_ADDR *fa,
           {
             state.q = q_scan_boxes (state.q, state.fa, state.nfa, state.to ? 1 : 0, config);
             state.q = q_sort(state.q, state.fa, state.nfa, config);
+            state.q_cursor = NULL;
           }
           continue;
         }
@@ -3548,45 +3626,21 @@ void protocol (SOCKET socket_in, SOCKET socket_out, FTN_NODE *to, FTN_ADDR *fa,
         else
 #endif
         {
-#ifdef DIAG_SEL
-          /* TEMPORARY (2026-08-16) -- one question, then it comes out.
-           *
-           * Sessions freeze for 1-3h between the M_ADR handler finishing and
-           * the remote's M_OK, with the socket holding thousands of unread
-           * bytes. Three facts point here and nowhere else: `timeout!' has
-           * NEVER been logged although nettimeout is 300s; DIAG_SPIN (which
-           * sits a few lines below this call) never fires, so the loop is not
-           * iterating; and DIAG_BSY proved bsy_add() completes normally, so
-           * the address loop had already finished.
-           *
-           * That leaves the SELECT() below not returning. On AmigaOS this is
-           * WaitSelect() via bsdsocket.library (amiga_glue.c), and if it
-           * ignores or loses its timeout the session can neither time out nor
-           * make progress -- which is exactly what the logs show, and would
-           * also explain why the poll and the resident server froze and
-           * released in the same second despite being separate processes.
-           *
-           * Logs only when the call overruns, so it is silent in normal
-           * operation: a healthy SELECT here returns within nettimeout. */
-          diag_sel_t0 = safe_time ();
-          diag_sel_tv = (long) tv.tv_sec;
-#endif
+          FR (state.fr, FR_SELECT, tv.tv_sec, FD_ISSET (socket_out, &w) ? 1 : 0);
           no = SELECT ((socket_in > socket_out ? socket_in : socket_out) + 1, &r, &w, 0, &tv);
-#ifdef DIAG_SEL
-          if (safe_time () - diag_sel_t0 > 60)
-            Log (1, "DIAG-SEL: SELECT returned %d after %lds but tv.tv_sec was %ld "
-                    "(nettimeout %d) - r=%d w=%d",
-                 no, (long) (safe_time () - diag_sel_t0), diag_sel_tv,
-                 config->nettimeout,
-                 FD_ISSET (socket_in, &r) ? 1 : 0,
-                 FD_ISSET (socket_out, &w) ? 1 : 0);
-#endif
+          FR (state.fr, FR_SELECTED, no,
+              (FD_ISSET (socket_in, &r) ? 1 : 0) | (FD_ISSET (socket_out, &w) ? 2 : 0));
         }
         if (no < 0)
           save_err = TCPERR ();
         Log (8, "selected %i (r=%i, w=%i)", no, FD_ISSET (socket_in, &r), FD_ISSET (socket_out, &w));
       }
-      bsy_touch (config);                       /* touch *.bsy's */
+#if defined(HAVE_FORK) && !defined(HAVE_THREADS)
+      bsy_touch (config);                       /* our locks live in this process */
+#else
+      if (inetd_flag)
+        bsy_touch (config);                     /* no manager to do it for us */
+#endif
       if (no == 0
 #ifdef BW_LIM
           && !limited
@@ -3594,6 +3648,7 @@ void protocol (SOCKET socket_in, SOCKET socket_out, FTN_NODE *to, FTN_ADDR *fa,
           )
       {
         state.io_error = 1;
+        FR (state.fr, FR_TIMEOUT, config->nettimeout, 0);
         Log (1, "timeout!");
         if (to)
           bad_try (&to->fa, "Timeout!", BAD_IO, config);
@@ -3611,68 +3666,6 @@ void protocol (SOCKET socket_in, SOCKET socket_out, FTN_NODE *to, FTN_ADDR *fa,
         break;
       }
 
-#ifdef DIAG_SPIN
-      /* TEMPORARY (2026-08-15) -- settles one question and then comes out.
-       *
-       * Sessions with 1:154/10@fidonet stall for 1-2 hours after the M_ADR
-       * handler completes, waiting on the remote's M_OK, then finish every
-       * remaining step within a single second -- so the data was buffered and
-       * we simply were not reading it. `timeout!' has NEVER been logged in the
-       * entire log, although nettimeout is 300s and the check is four lines
-       * above this one. A two-hour wait should have tripped it ~24 times.
-       *
-       * Only two shapes fit: either this loop keeps running with select()
-       * returning >0 and nothing progressing (a spin), or the task is not in
-       * this loop at all (blocked somewhere else entirely).
-       *
-       * This tells the two apart without inference. If it is a spin, the
-       * counter climbs and we get the loop state; if the task is blocked
-       * outside the loop, NOTHING is logged during the stall -- and that
-       * silence is itself the answer. Throttled to one line a minute so a
-       * fast spin cannot flood the log.
-       *
-       * Counters are locals of protocol(), NOT statics: session Processes
-       * share one address space here, so a static would be shared by every
-       * concurrent session and the numbers would be meaningless. */
-      {
-        unsigned long sig = (unsigned long) state.iread
-                          + (unsigned long) state.oleft
-                          + (unsigned long) state.n_msgs
-                          + (unsigned long) state.msgs_in_batch
-                          + (unsigned long) state.bytes_rcvd
-                          + (unsigned long) state.bytes_sent;
-        time_t dnow = safe_time ();
-
-        if (sig != diag_sig)
-        {                                  /* something moved: reset */
-          diag_sig = sig;
-          diag_idle = 0;
-          diag_idle_since = dnow;
-        }
-        else
-        {
-          ++diag_idle;
-          if (diag_idle_since == 0)
-            diag_idle_since = dnow;
-          if (dnow - diag_idle_since >= 60 && dnow - diag_last_report >= 60)
-          {
-            unsigned long secs = (unsigned long) (dnow - diag_idle_since);
-
-            diag_last_report = dnow;
-            Log (1, "DIAG-SPIN: no progress %lus, %lu passes (%lu/s), select=%d "
-                    "isize=%d iread=%d oleft=%d nmsgs=%d state=%d/%d "
-                    "EOB l/r=%d/%d wGOT=%d nsent=%d in.f=%d out.f=%d",
-                 secs, diag_idle, diag_idle / (secs ? secs : 1), no,
-                 state.isize, state.iread, state.oleft, state.n_msgs,
-                 state.state, state.state_ext,
-                 state.local_EOB, state.remote_EOB,
-                 state.waiting_for_GOT, state.n_sent_fls,
-                 state.in.f ? 1 : 0, state.out.f ? 1 : 0);
-          }
-        }
-      }
-#endif
-
       rd = FD_ISSET (socket_in, &r);
       if (rd)       /* Have something to read */
       {
@@ -3779,8 +3772,11 @@ void protocol (SOCKET socket_in, SOCKET socket_out, FTN_NODE *to, FTN_ADDR *fa,
     hold_node (&to->fa, safe_time() + config->hold_skipped, config);
   }
 
+  FR (state.fr, FR_CLOSED, status, state.io_error);
+  if (status && state.io_error)
+    flight_dump (state.fr, "session error");
   deinit_protocol (&state, config, status);
-  evt_set (state.evt_queue);
+  evt_set (state.evt_queue, config);
   state.evt_queue = NULL;
   Log (5, "session closed, quitting...");
 }
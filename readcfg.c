@@ -11,6 +11,8 @@
  *  (at your option) any later version. See COPYING.
  */
 
+#define LOG_SUBSYS config    /* loglevel-config, see tools.h */
+
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -158,6 +160,14 @@ static void destroy_shares(void *p)
   simplelist_free(&pp->sfa.linkpoint, NULL);
 }
 
+static void destroy_nodelist(void *p)
+{
+  struct nodelistchain *pp = p;
+
+  nodelist_close(pp);
+  xfree(pp->path);
+}
+
 #if defined(WITH_ZLIB) || defined(WITH_BZLIB2)
 static void destroy_zrule(void *p)
 {
@@ -203,6 +213,8 @@ static void destroy_proxy(void *p)
  */
 void lock_config_structure(BINKD_CONFIG *c)
 {
+  int i;
+
   if (++(c->usageCount) == 1)
   {
     /* First-time call: init default values */
@@ -211,6 +223,7 @@ void lock_config_structure(BINKD_CONFIG *c)
     snprintf(c->oport, sizeof(c->oport), "%s", find_port(""));
     c->call_delay        = 60;
     c->rescan_delay      = 60;
+    c->bsy_refresh       = 50;
     c->nettimeout        = DEF_TIMEOUT;
     c->oblksize          = DEF_BLKSIZE;
 #if defined(WITH_ZLIB) || defined(WITH_BZLIB2)
@@ -223,6 +236,9 @@ void lock_config_structure(BINKD_CONFIG *c)
     c->minfree_nonsecure = -1;
     c->loglevel          = 4;
     c->conlog            = 1;
+    for (i = 0; i < LOG_NSUBSYS; i++)
+      c->loglevel_sub[i] = -1;
+    c->log_keep          = 5;
     c->inboundcase       = INB_SAVE;
     /* v10.18: AmigaOS defaults this OFF because touch() can block forever.
      *
@@ -304,6 +320,7 @@ void unlock_config_structure(BINKD_CONFIG *c, int on_exit)
     simplelist_free(&c->evt_flags.linkpoint,   destroy_evtflags);
     simplelist_free(&c->akamask.linkpoint,     destroy_akachain);
     simplelist_free(&c->shares.linkpoint,      destroy_shares);
+    simplelist_free(&c->nodelists.linkpoint,   destroy_nodelist);
 #if defined(WITH_ZLIB) || defined(WITH_BZLIB2)
     simplelist_free(&c->zrules.linkpoint,      destroy_zrule);
 #endif
@@ -381,6 +398,7 @@ static int read_port (KEYWORD *key, int wordcount, char **words);
 static int read_listen (KEYWORD *key, int wordcount, char **words);
 static int read_skip (KEYWORD *key, int wordcount, char **words);
 static int read_check_pkthdr (KEYWORD *key, int wordcount, char **words);
+static int read_nodelist (KEYWORD *key, int wordcount, char **words);
 #if defined(WITH_ZLIB) || defined(WITH_BZLIB2)
 static int read_zrule (KEYWORD *key, int wordcount, char **words);
 #endif
@@ -407,6 +425,17 @@ static KEYWORD keywords[] =
   {"log", read_log_string, work_config.logpath, 'f', 0},
   {"loglevel", read_log_int, &work_config.loglevel, 0, DONT_CHECK},
   {"conlog", read_log_int, &work_config.conlog, 0, DONT_CHECK},
+  {"loglevel-protocol", read_log_int, &work_config.loglevel_sub[LOGS_protocol], 0, DONT_CHECK},
+  {"loglevel-queue", read_log_int, &work_config.loglevel_sub[LOGS_queue], 0, DONT_CHECK},
+  {"loglevel-bsy", read_log_int, &work_config.loglevel_sub[LOGS_bsy], 0, DONT_CHECK},
+  {"loglevel-inbound", read_log_int, &work_config.loglevel_sub[LOGS_inbound], 0, DONT_CHECK},
+  {"loglevel-config", read_log_int, &work_config.loglevel_sub[LOGS_config], 0, DONT_CHECK},
+  {"log-rotate", read_int, &work_config.log_rotate, 0, DONT_CHECK},
+  {"log-rotate-time", read_time, &work_config.log_rotate_time, 0, DONT_CHECK},
+  {"log-keep", read_int, &work_config.log_keep, 1, 99},
+#ifdef WITH_ZLIB
+  {"log-compress", read_bool, &work_config.log_compress, 0, 0},
+#endif
   {"binlog", read_string, work_config.binlogpath, 'f', 0},
   {"fdinhist", read_string, work_config.fdinhist, 'f', 0},
   {"fdouthist", read_string, work_config.fdouthist, 'f', 0},
@@ -432,20 +461,30 @@ static KEYWORD keywords[] =
   {"temp-inbound", read_string, work_config.temp_inbound, 'd', 0},
   {"node", read_node_info, NULL, 0, 0},
   {"defnode", read_node_info, NULL, 1, 0},
+  {"nodelist", read_nodelist, NULL, 0, 0},
   {"kill-dup-partial-files", read_bool, &work_config.kill_dup_partial_files, 0, 0},
   {"kill-old-partial-files", read_time, &work_config.kill_old_partial_files, 1, DONT_CHECK},
   {"kill-old-bsy", read_time, &work_config.kill_old_bsy, 1, DONT_CHECK},
+  {"bsy-refresh", read_int, &work_config.bsy_refresh, 10, 90},
+  {"shared-bsy", read_bool, &work_config.shared_bsy, 0, 0},
+  {"commit-batch", read_int, &work_config.commit_batch, 0, 1000},
+  {"dup-window", read_time, &work_config.dup_window, 1, DONT_CHECK},
+  {"dup-skip", read_bool, &work_config.dup_skip, 0, 0},
+  {"prealloc-inbound", read_int, &work_config.prealloc_inbound, 0, DONT_CHECK},
   {"percents", read_bool, &work_config.percents, 0, 0},
   {"minfree", read_int, &work_config.minfree, 0, DONT_CHECK},
   {"minfree-nonsecure", read_int, &work_config.minfree_nonsecure, 0, DONT_CHECK},
   {"flag", read_flag_exec_info, NULL, 'f', 0},
   {"exec", read_flag_exec_info, NULL, 'e', 0},
+  {"event-workers", read_int, &work_config.evt_workers, 0, 16},
   {"printq", read_bool, &work_config.printq, 0, 0},
   {"try", read_int, &work_config.tries, 0, 0xffff},
   {"hold", read_time, &work_config.hold, 0, DONT_CHECK},
   {"hold-skipped", read_time, &work_config.hold_skipped, 0, DONT_CHECK},
   {"backresolv", read_bool, &work_config.backresolv, 0, 0},
   {"pid-file", read_string, work_config.pid_file, 'f', 0},
+  {"queue-snapshot", read_string, work_config.q_snapshot, 'f', 0},
+  {"flight-dump", read_string, work_config.flight_dump, 'f', 0},
   {"remove-try-files", read_bool, &work_config.remove_try_files, 0, 0},
 #ifdef HTTPS
   {"proxy", read_string, work_config.proxy, 0, BINKD_FQDNLEN + 40},
@@ -958,7 +997,10 @@ int checkcfg(void)
   if (new_config)
   {
     InitLog(new_config->loglevel, new_config->conlog,
-            new_config->logpath, new_config->nolog.first);
+            new_config->logpath, new_config->nolog.first,
+            new_config->loglevel_sub);
+    InitLogRotate(new_config->log_rotate, new_config->log_rotate_time,
+                  new_config->log_keep, new_config->log_compress);
 
 #ifdef WITH_PERL
     /* before change current_config,
@@ -1446,7 +1488,8 @@ static void log_bootstrap(void)
      * will config (and their memory) be accepted or free'd.
      * We can duplicate them in InitLog() but it'll be overkill.
      */
-    InitLog(work_config.loglevel, work_config.conlog, work_config.logpath, NULL);
+    InitLog(work_config.loglevel, work_config.conlog, work_config.logpath, NULL,
+            work_config.loglevel_sub);
   }
 }
 
@@ -1822,6 +1865,44 @@ static int read_check_pkthdr (KEYWORD *key, int wordcount, char **words)
 
   return 1;
 }
+
+/* nodelist <path> [<domain>] */
+static int read_nodelist (KEYWORD *key, int wordcount, char **words)
+{
+  struct nodelistchain new_entry;
+  FTN_DOMAIN *d;
+  FILE *f;
+
+  if (wordcount != 1 && wordcount != 2)
+    return SyntaxError(key);
+
+  if (wordcount == 2)
+  {
+    if ((d = get_domain_info (words[1], work_config.pDomains.first)) == NULL)
+      return ConfigError("%s: undefined domain", words[1]);
+  }
+  else if ((d = work_config.pDomains.first) == NULL)
+    return ConfigError("at least one domain must be defined first");
+
+  if ((f = fopen (words[0], "r")) == NULL)
+    return ConfigError("cannot open nodelist %s: %s", words[0], strerror(errno));
+  /* a new nodelist reloads the config, which reindexes it */
+  add_to_config_list(words[0], f);
+  fclose(f);
+
+  memset(&new_entry, 0, sizeof(new_entry));
+  new_entry.path = xstrdup(words[0]);
+  strnzcpy(new_entry.domain, d->name, sizeof(new_entry.domain));
+  if (!nodelist_open(&new_entry))
+  {
+    xfree(new_entry.path);
+    return ConfigError("%s: cannot index nodelist", words[0]);
+  }
+  simplelist_add(&work_config.nodelists.linkpoint, &new_entry, sizeof(new_entry));
+
+  return 1;
+}
+
 #ifdef BW_LIM
 /* parse `<rate>[kM%]|-' string
    return in err pointer to error, NULL if no error */
@@ -2159,6 +2240,12 @@ void debug_readcfg (void)
       else
         printf(work_config.havedefnode ? "[see 0:0/0@defnode]" : "<not defined>");
     }
+    else if (k->callback == read_nodelist)
+    {
+      struct nodelistchain *c;
+      for (c = work_config.nodelists.first; c; c = c->next)
+        printf("\n    %s @%s", c->path, c->domain);
+    }
     else if (k->callback == read_flag_exec_info)
     {
       EVT_FLAG *c;
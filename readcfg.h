@@ -19,6 +19,8 @@
 #include "Config.h"
 #include "btypes.h"
 #include "iphdr.h"
+#include "nodelist.h"
+#include "tools.h"
 
 typedef struct _BINKD_CONFIG BINKD_CONFIG;
 
@@ -99,7 +101,11 @@ struct _BINKD_CONFIG
 
   int        nNod;           /* number of nodes */
   FTN_NODE   **pNodArray;    /* array of pointers to nodes  */
+  int        nNodAlloc;      /* allocated size of pNodArray */
   int        nNodSorted;     /* internal flag   */
+  struct node_table *pNodHash;    /* address hash over the same nodes */
+  struct node_table *pNodRetired; /* outgrown hashes, see ftnnode.c */
+  struct node_snap  *pNodSnap;    /* sorted copy for foreach_node() */
   int        q_present;      /* BSO scan: queue not empty */
 
   char       iport[MAXSERVNAME + 1];
@@ -118,6 +124,13 @@ struct _BINKD_CONFIG
   int        kill_dup_partial_files;
   int        kill_old_partial_files;
   int        kill_old_bsy;
+  int        bsy_refresh;
+  int        shared_bsy;
+  int        commit_batch;
+  int        prealloc_inbound;
+  int        evt_workers;
+  int        dup_window;
+  int        dup_skip;
   int        minfree;
   int        minfree_nonsecure;
   int        tries;
@@ -129,6 +142,11 @@ struct _BINKD_CONFIG
   int        debugcfg;
   int        loglevel;
   int        conlog;
+  int        loglevel_sub[LOG_NSUBSYS];    /* -1: loglevel */
+  int        log_rotate;                   /* KB, 0: off */
+  int        log_rotate_time;              /* seconds, 0: off */
+  int        log_keep;
+  int        log_compress;
   int        printq;
   int        percents;
   int        tzoff;
@@ -156,6 +174,7 @@ struct _BINKD_CONFIG
   DEFINE_LIST(akachain)      akamask;
   DEFINE_LIST(listenchain)   listen;
   DEFINE_LIST(_SHARED_CHAIN) shares; /* Linked list for shared akas header */
+  DEFINE_LIST(nodelistchain) nodelists;
 #if defined(WITH_ZLIB) || defined(WITH_BZLIB2)
   DEFINE_LIST(zrule)         zrules;
 #endif
@@ -191,6 +210,8 @@ struct _BINKD_CONFIG
   char       fdinhist[MAXPATHLEN + 1];
   char       fdouthist[MAXPATHLEN + 1];
   char       pid_file[MAXPATHLEN + 1];
+  char       q_snapshot[MAXPATHLEN + 1];  /* queue-snapshot, "" = none */
+  char       flight_dump[MAXPATHLEN + 1]; /* flight-dump, "" = none */
   char       passwords[MAXPATHLEN + 1];
 #ifdef MAILBOX
   char       tfilebox[MAXPATHLEN + 1];   /* FileBoxes dir */
@@ -157,6 +157,9 @@ extern MUTEXSEM resolvsem;
  * A private lsem let their output interleave mid-line. See amiga/sem.c. */
 void *amiga_public_log_sem (void);
 #define LOG_SEM (amiga_public_log_sem() ? amiga_public_log_sem() : (void *)&lsem)
+/* A named semaphore with size bytes of public memory (*data) behind it,
+ * shared by all instances. NULL if it cannot be had. */
+void *amiga_public_area (char *name, unsigned long size, void **data);
 #else
 #define LOG_SEM ((void *)&lsem)
 #endif
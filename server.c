@@ -31,6 +31,9 @@
 #include "iptools.h"
 #include "tools.h"
 #include "protocol.h"
+#include "bsy.h"
+#include "inbound.h"
+#include "flight.h"
 #include "assert.h"
 #include "setpttl.h"
 #include "sem.h"
@@ -90,6 +93,7 @@ static void serv (void *arg)
   int h = *(int *) arg;
 #endif
   BINKD_CONFIG *config;
+  FLIGHT *fr;
 #if defined(WITH_PERL) && defined(HAVE_THREADS)
   void *cperl;
 #endif
@@ -135,6 +139,7 @@ static void serv (void *arg)
 #endif
 
   config = lock_current_config();
+  fr = flight_start (config);
 #if defined(WITH_PERL) && defined(HAVE_THREADS)
   cperl = perl_init_clone(config);
 #endif
@@ -143,15 +148,21 @@ static void serv (void *arg)
 #if defined(WITH_PERL) && defined(HAVE_THREADS)
   perl_done_clone(cperl);
 #endif
+  FR (fr, FR_SOCLOSE, h, 0);
   del_socket(h);
   soclose (h);
+  FR (fr, FR_SOCLOSED, 0, 0);
 #ifdef AMIGA
   /* After soclose(): the socket lives in this private base, so the base
    * has to outlive it. */
   Log (7, "handoff: child closing fd %i, base=%p, n_servers=%i",
        h, (void *) privSocketBase, n_servers);
+  FR (fr, FR_SOCLOSE, -1, 0);
   amiga_close_private_socketbase (privSocketBase);
+  FR (fr, FR_SOCLOSED, 0, 0);
 #endif
+  FR (fr, FR_END, 0, 0);
+  flight_end (fr);
   free (arg);
   unlock_config_structure(config, 0);
   rel_grow_handles (-6);
@@ -287,6 +298,11 @@ static int do_server(BINKD_CONFIG *config)
     tv.tv_sec  = CHECKCFG_INTERVAL;
     unblocksig();
     check_child(&n_servers);
+    delete_pending(0);
+    DrainLog();
+    bsy_refresh(config);
+    inb_sweep_partials(config);
+    flight_watch();
     n = select(maxfd+1, &r, NULL, NULL, &tv);
     blocksig();
     switch (n)
@@ -26,6 +26,8 @@
 #include "prothlp.h"
 #include "protocol.h"
 #include "rfc2553.h"
+#include "sem.h"
+#include "common.h"
 
 static EVTQ *evt_queue(EVTQ *eq, char evt_type, char *path)
 {
@@ -75,26 +77,167 @@ int evt_test (EVTQ **eq, char *filename, EVT_FLAG *evt_flags)
   return rc;
 }
 
+static void evt_do (EVTQ *eq)
+{
+  if (eq->evt_type == 'e')
+  {
+    Log (4, "Running %s", eq->path);
+    run(eq->path);
+  }
+  else
+  {
+    Log (4, "Creating %s", eq->path);
+    if (create_empty_sem_file(eq->path) == 0)
+      touch(eq->path, time(NULL));
+  }
+}
+
 /*
- * Sets flags for all matched with evt_test events
+ * Delayed events used to be run by the session itself after the last
+ * file, before its socket was closed and its slot given back: a tosser
+ * taking a minute kept the remote waiting and a server slot taken for
+ * that minute. With event-workers they are handed to up to that many
+ * worker threads (Processes on AmigaOS), started when there is work
+ * and gone when there is none.
+ *
+ * An event already waiting is not queued again -- ten sessions ending
+ * together start the tosser once, not ten times -- and the same command
+ * line never runs twice at once. When EVT_QUEUE_MAX events are waiting
+ * the session runs its own, as before.
  */
-void evt_set (EVTQ *eq)
+#define EVT_QUEUE_MAX 64
+
+#if defined(HAVE_THREADS) || defined(AMIGA)
+static MUTEXSEM evtsem;
+static EVTQ *evt_waiting, *evt_running;
+static int evt_nwaiting, evt_nworkers;
+
+void evt_init (void)
 {
-  EVTQ *curr;
+  InitSem (&evtsem);
+}
 
-  while (eq)
+int evt_busy (void)
+{
+  int n;
+
+  LockSem (&evtsem);
+  n = evt_nworkers;
+  ReleaseSem (&evtsem);
+  return n;
+}
+
+/*
+ * Moves the first waiting event whose command is not running to the
+ * running list. Under evtsem.
+ */
+static EVTQ *evt_take (void)
+{
+  EVTQ **pp, *eq, *r;
+
+  for (pp = &evt_waiting; (eq = *pp) != NULL; pp = &eq->next)
+  {
+    for (r = evt_running; r; r = r->next)
+      if (r->evt_type == eq->evt_type && !strcmp (r->path, eq->path))
+        break;
+    if (r == NULL)
+    {
+      *pp = eq->next;
+      eq->next = evt_running;
+      evt_running = eq;
+      evt_nwaiting--;
+      return eq;
+    }
+  }
+  return NULL;
+}
+
+static void evt_worker (void *arg)
+{
+  EVTQ **pp, *eq;
+
+  LockSem (&evtsem);
+  while ((eq = evt_take ()) != NULL)
   {
-    if (eq->evt_type == 'e')
+    ReleaseSem (&evtsem);
+    evt_do (eq);
+    LockSem (&evtsem);
+    for (pp = &evt_running; *pp != eq; pp = &(*pp)->next);
+    *pp = eq->next;
+    free (eq->path);
+    free (eq);
+  }
+  evt_nworkers--;
+  ReleaseSem (&evtsem);
+  if (arg == NULL)
+    PostSem (&eothread);
+}
+
+/*
+ * Queues eq for the workers, starting more of them if needed.
+ * Returns what did not fit.
+ */
+static EVTQ *evt_post (EVTQ *eq, BINKD_CONFIG *config)
+{
+  EVTQ *curr, *w, **tail;
+  int start = 0;
+
+  LockSem (&evtsem);
+  for (tail = &evt_waiting; *tail; tail = &(*tail)->next);
+  while (eq && evt_nwaiting < EVT_QUEUE_MAX)
+  {
+    curr = eq;
+    eq = eq->next;
+    for (w = evt_waiting; w; w = w->next)
+      if (w->evt_type == curr->evt_type && !strcmp (w->path, curr->path))
+        break;
+    if (w)
     {
-      Log (4, "Running %s", eq->path);
-      run(eq->path);
+      Log (6, "%s is waiting already", curr->path);
+      free (curr->path);
+      free (curr);
+      continue;
     }
-    else
+    curr->next = NULL;
+    *tail = curr;
+    tail = &curr->next;
+    evt_nwaiting++;
+  }
+  while (evt_nworkers + start < config->evt_workers &&
+         evt_nworkers + start < evt_nwaiting)
+    start++;
+  evt_nworkers += start;
+  ReleaseSem (&evtsem);
+
+  while (start-- > 0)
+  {
+    if (branch (evt_worker, NULL, 0) < 0)
     {
-      Log (4, "Creating %s", eq->path);
-      if (create_empty_sem_file(eq->path) == 0)
-	touch(eq->path, time(NULL));
+      Log (1, "cannot start an event worker, running the events here");
+      evt_worker ((void *) 1);          /* no thread, do it ourselves */
     }
+  }
+  return eq;
+}
+#endif
+
+/*
+ * Sets flags for all matched with evt_test events
+ */
+void evt_set (EVTQ *eq, BINKD_CONFIG *config)
+{
+  EVTQ *curr;
+
+#if defined(HAVE_THREADS) || defined(AMIGA)
+  if (config->evt_workers > 0 && eq)
+  {
+    if ((eq = evt_post (eq, config)) != NULL)
+      Log (4, "event queue is full, running the events here");
+  }
+#endif
+  while (eq)
+  {
+    evt_do (eq);
     curr = eq->next;
     free(eq->path);
     free(eq);
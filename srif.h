@@ -38,7 +38,20 @@ FTNQ *evt_run (FTNQ *q, char *filename0, int imm_freq,
 
 /*
  * Sets flags for all matched with evt_test events
+ * (through the event workers if event-workers is set)
  */
-void evt_set (EVTQ *eq);
+void evt_set (EVTQ *eq, BINKD_CONFIG *config);
+
+/*
+ * The event workers: init once; evt_busy() -- how many are running,
+ * exitfunc() waits for them.
+ */
+#if defined(HAVE_THREADS) || defined(AMIGA)
+void evt_init (void);
+int evt_busy (void);
+#else
+#define evt_init()
+#define evt_busy() 0
+#endif
 
 #endif
@@ -1,19 +1,127 @@
 #!/usr/bin/env python3
 """Verify a logtest run. Every line must be exactly 64 characters, well
-formed, and each (id, seq) pair must appear exactly once."""
-import sys, re, collections
+formed, and each (id, seq) pair must appear exactly once.
 
-path = sys.argv[1] if len(sys.argv) > 1 else \
+    check_logtest.py [path]                            logtest, logtest2/3
+    check_logtest.py --mailer path writers count       logtest4
+    check_logtest.py --rotate path count keep sizeKB   logtest5
+
+With --mailer the lines carry the log's own prefix, which is stripped
+first. On top of the above, every "GATE pass" line and no "GATE drop"
+line must be there, and the "LAST" line must be the last one.
+
+With --rotate (sizeKB 0: by time) see logtest5.c for what is checked."""
+import sys, re, os, zlib, collections
+
+args = sys.argv[1:]
+prefix = re.compile(r'^[!?+\- ] \d\d [A-Z][a-z]{2} (\d\d):(\d\d):(\d\d) \[\d+\] ')
+
+
+def rotate(path, count, keep, size):
+    PERIOD = 2                          # logtest5.c
+    rot = re.compile(r'^ROT seq=(\d{6}) R{44}$')
+    errs, gens = [], []
+    d = os.path.dirname(path) or '.'
+    for f in os.listdir(d):
+        m = re.match(re.escape(os.path.basename(path)) + r'\.(\d+)(\.z)?(t)?$', f)
+        if not m:
+            continue
+        if m.group(3):
+            errs.append(f'{f}: half-written packed file left over')
+        else:
+            gens.append((int(m.group(1)), bool(m.group(2))))
+    nums = sorted(n for n, z in gens)
+    n = nums[-1] if nums else 0
+    if nums != list(range(1, n + 1)):
+        errs.append(f'generations {nums}: not 1..{n} once each')
+    if n > keep:
+        errs.append(f'{n} generations kept, log-keep {keep}')
+    if n == 0:
+        errs.append('never rotated')
+    zipped = any(z for _, z in gens)
+    files = [(f'{path}.{g}' + ('.z' if z else ''), z)
+             for g, z in sorted(gens, reverse=True)] + [(path, False)]
+
+    seqs = []
+    for f, z in files:
+        data = open(f, 'rb').read()
+        if z:
+            data = zlib.decompress(data)
+        if size and not zipped and len(data) > size * 1024:
+            errs.append(f'{f}: {len(data)} bytes, log-rotate {size} KB')
+        periods = []
+        for l in data.decode('latin-1').split('\n'):
+            if l == '':
+                continue
+            m = prefix.match(l)
+            r = rot.match(l[m.end():]) if m else None
+            if not r:
+                errs.append(f'{f}: malformed {l[:56]!r}')
+                continue
+            seqs.append(int(r.group(1)))
+            h, mi, se = map(int, m.groups())
+            periods.append((h * 3600 + mi * 60 + se) // PERIOD)
+        if not size and len(periods) > 1:
+            p = periods[-1]
+            if set(periods[1:]) != {p} or periods[0] not in (p, p - 1):
+                errs.append(f'{f}: lines of more than one period')
+        print(f"  {f:40s} {len(periods):6d} lines"
+              f"{'  packed' if z else ''}")
+
+    if not seqs or seqs[-1] != count - 1:
+        errs.append(f'last line {seqs[-1] if seqs else None}, '
+                    f'logged {count - 1}')
+    gaps = [(a, b) for a, b in zip(seqs, seqs[1:]) if b != a + 1]
+    if gaps:
+        errs.append(f'{len(gaps)} gaps or repeats, e.g. {gaps[:4]}')
+    print(f"  generations : {n}, log-keep {keep}"
+          f"{', packed: size not checked' if zipped and size else ''}")
+    print(f"  lines       : {len(seqs)}, "
+          f"{seqs[0] if seqs else '-'}..{seqs[-1] if seqs else '-'}")
+    for e in errs[:12]:
+        print(f"      {e}")
+    ok = not errs
+    print(f"\n  RESULT: {'PASS -- rotation is sound' if ok else 'FAIL -- rotation lost its way'}")
+    sys.exit(0 if ok else 1)
+
+
+if args and args[0] == '--rotate':
+    rotate(args[1], int(args[2]), int(args[3]), int(args[4]))
+mailer = bool(args) and args[0] == '--mailer'
+if mailer:
+    args = args[1:]
+path = args[0] if args else \
     '/home/spitfiretn/Amiberry/HardDrives/DH4/logtest-out.txt'
-WRITERS, PER = 5, 200
+WRITERS, PER = (int(args[1]), int(args[2])) if mailer else (5, 200)
 EXPECT = WRITERS * PER
 pat = re.compile(r'^LINE id=(\d{2}) seq=(\d{4}) ([A-Z])\3{43}$')
+GATES = ['GATE pass loglevel 3', 'GATE pass bsy 5', 'GATE pass queue 1',
+         'GATE pass protocol 3']
 
 raw = open(path, 'rb').read().decode('latin-1')
 lines = raw.split('\n')
 if lines and lines[-1] == '':
     lines.pop()
 
+gates, drops, last = [], [], None
+if mailer:
+    body = []
+    for n, l in enumerate(lines, 1):
+        if l == '':
+            continue                    # log_write()'s blank first line
+        m = prefix.match(l)
+        l = l[m.end():] if m else l
+        if l.startswith('GATE pass'):
+            gates.append(l)
+        elif l.startswith('GATE drop'):
+            drops.append(l)
+        elif l.startswith('LAST'):
+            last = (n, l)
+        else:
+            body.append(l)
+    last_ok = last is not None and last[0] == len(lines)
+    lines = body
+
 good, bad, seen = 0, [], collections.Counter()
 for n, l in enumerate(lines, 1):
     m = pat.match(l)
@@ -38,5 +146,12 @@ for n, ln, txt in bad[:8]:
 if missing[:6]:
     print(f"      missing e.g. {missing[:6]}")
 ok = (len(lines) == EXPECT and not bad and not missing and not dupes)
+if mailer:
+    print(f"  gates       : {len(gates)} of {len(GATES)} passed, "
+          f"{len(drops)} that should have been dropped")
+    for g in drops:
+        print(f"      {g!r}")
+    print(f"  last line   : {last[1] if last_ok else 'MISSING or not last'}")
+    ok = ok and sorted(gates) == sorted(GATES) and not drops and last_ok
 print(f"\n  RESULT: {'PASS -- append is honoured' if ok else 'FAIL -- writes are landing wrong'}")
 sys.exit(0 if ok else 1)
@@ -0,0 +1,163 @@
+/* logtest4 -- the mailer's own log path, not a copy of it.
+ *
+ * logtest, logtest2 and logtest3 rebuild the old Log() write by hand:
+ * lock, fopen(path,"a"), one line, fclose, unlock. That is no longer what
+ * ships. Log() now drops a line above its level before formatting it
+ * (loglevel and the per-subsystem loglevel-xxx), takes the stamp from a
+ * once-a-second cache, and hands the line to a queue (log_put()). The
+ * managers write it out a buffer at a time (DrainLog()); a caller does
+ * only when the queue is half full or old, or the line is an error.
+ * FlushLog() empties it on exit and before a level 0 exit. None of that
+ * can be tested by a copy, so this links tools.c itself and runs its
+ * writers through branch.c, as sessions are run.
+ *
+ *   1. Gates. InitLog() with loglevel 3, loglevel-bsy 5, loglevel-queue 1
+ *      and no level for protocol (so loglevel). For each gate one line
+ *      just inside it ("GATE pass ...") and one just above ("GATE drop
+ *      ...").
+ *
+ *   2. Writers. <writers> branch()ed writers (Processes on AmigaOS,
+ *      threads elsewhere) Log() <count> lines each, as fast as they can,
+ *      so the queue fills and the writer role changes hands, while main()
+ *      calls DrainLog() as the managers do. Each line is the 64-character
+ *      line of logtest after the log's own prefix.
+ *
+ *   3. Exit. Mode 0 ends with Log(0, ...), which must write out what is
+ *      queued, its own line last, and exit(1). Mode 1 returns from main()
+ *      with FlushLog() registered by atexit(), the way exitfunc() calls
+ *      it, after one last line; exit code 0.
+ *
+ * Usage:  logtest4 <path> <writers 1-9> <count> <mode 0|1>
+ *
+ * Verify with:  tests/check_logtest.py --mailer <path> <writers> <count>
+ *
+ * Build from the top of the tree, after a normal build, AmigaOS:
+ *   m68k-amigaos-gcc -mcrt=nix13 -msoft-float <DEFINES of the Makefile> -I. \
+ *     -o logtest4 tests/logtest4.c tools.o xalloc.o branch.o pmatch.o \
+ *     amiga_glue.o and the objects in amiga/
+ * and with pthreads on a host, to try the same code with real threads:
+ *   gcc -DUNIX -DHAVE_THREADS -DWITH_PTHREADS -DHAVE_STDARG_H \
+ *     -DHAVE_SNPRINTF -DHAVE_VSNPRINTF -DHAVE_UNISTD_H -DHAVE_SYS_TIME_H \
+ *     -DHAVE_SOCKLEN_T -DHAVE_MSG_NOSIGNAL -DOS=\"UNIX\" -I. \
+ *     -o logtest4 tests/logtest4.c tools.c xalloc.c branch.c pmatch.c \
+ *     -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef AMIGA
+#include <unistd.h>
+#endif
+
+#include "sys.h"
+#include "readcfg.h"
+#include "common.h"
+#include "tools.h"
+#include "sem.h"
+
+/* What tools.c and branch.c take from the rest of the mailer */
+int inetd_flag = 0;
+#if defined(HAVE_THREADS) || defined(AMIGA)
+MUTEXSEM lsem, varsem;
+#endif
+
+char *mask_test (char *s, struct maskchain *chain)
+{
+  return NULL;                          /* no nolog */
+}
+
+#ifndef AMIGA
+int o_rename (const char *from, const char *to)
+{
+  return rename (from, to);
+}
+#endif
+
+#ifdef AMIGA
+#define TICK() amiga_msleep (10)
+#else
+#define TICK() usleep (10000)
+#endif
+
+typedef struct { int id, count; } wargs_t;
+
+static volatile int g_alive;
+
+static void writer (void *arg)
+{
+  wargs_t *w = (wargs_t *) arg;
+  char filler[45];
+  int seq;
+
+  memset (filler, 'A' + (w->id % 26), 44);
+  filler[44] = '\0';
+  for (seq = 0; seq < w->count; ++seq)
+    Log (2, "LINE id=%02d seq=%04d %s", w->id, seq % 10000, filler);
+  free (w);
+  threadsafe (g_alive--);
+}
+
+int main (int argc, char **argv)
+{
+  int sub[LOG_NSUBSYS];
+  int writers, count, mode, i, waited = 0;
+
+  if (argc < 5)
+  {
+    printf ("usage: logtest4 <path> <writers 1-9> <count> <mode 0|1>\n");
+    return 20;
+  }
+  writers = atoi (argv[2]);
+  count   = atoi (argv[3]);
+  mode    = atoi (argv[4]);
+  if (writers < 1 || writers > 9) { printf ("writers 1-9\n"); return 20; }
+
+  InitSem (&lsem);
+  InitSem (&varsem);
+  for (i = 0; i < LOG_NSUBSYS; i++)
+    sub[i] = -1;
+  sub[LOGS_bsy]   = 5;
+  sub[LOGS_queue] = 1;
+  InitLog (3, -1, argv[1], NULL, sub);
+
+  /* 1. gates */
+  Log (3, "GATE pass loglevel 3");
+  Log (4, "GATE drop loglevel 4");
+  Log_bsy (5, "GATE pass bsy 5");
+  Log_bsy (6, "GATE drop bsy 6");
+  Log_queue (1, "GATE pass queue 1");
+  Log_queue (2, "GATE drop queue 2");
+  Log_protocol (3, "GATE pass protocol 3");
+  Log_protocol (4, "GATE drop protocol 4");
+
+  /* 2. writers */
+  for (i = 0; i < writers; ++i)
+  {
+    wargs_t w;
+
+    w.id = i;
+    w.count = count;
+    threadsafe (g_alive++);
+    if (branch (writer, &w, sizeof (w)) < 0)
+    {
+      threadsafe (g_alive--);
+      printf ("logtest4: writer %d: cannot branch\n", i);
+    }
+  }
+  while (g_alive > 0 && waited < 9000)
+  {
+    DrainLog ();
+    TICK ();
+    waited++;
+  }
+  printf ("logtest4: %d writers x %d lines, %d still running\n",
+          writers, count, (int) g_alive);
+
+  /* 3. exit */
+  if (mode == 0)
+    Log (0, "LAST level 0, exit 1");
+  atexit (FlushLog);
+  Log (1, "LAST atexit, exit 0");
+  return 0;
+}
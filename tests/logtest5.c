@@ -0,0 +1,123 @@
+/* logtest5 -- log-rotate, log-rotate-time, log-keep and log-compress.
+ *
+ * Links tools.c as logtest4 does and logs <count> numbered lines through
+ * Log(), one writer, with rotation switched on:
+ *
+ *   size KB > 0   log-rotate <size KB>, as fast as it can;
+ *   size KB = 0   log-rotate-time of 2 seconds, a line every 250 ms, so
+ *                 a run of <count> lines sees about <count>/8 periods.
+ *
+ * log-keep is <keep>. With zip 1 (zlib builds only, see log_zip()) each
+ * <path>.1 is packed into <path>.1.z; the run waits for the last one to
+ * be done before it ends. Then FlushLog(), as on exit.
+ *
+ * What must hold, checked on the host by check_logtest.py --rotate:
+ * generations 1..n with n <= keep and none missing in between, each one
+ * either packed or not, no half-written .zt left over; read oldest
+ * first, the lines run on without a gap or a repeat and end at the last
+ * one logged; by size, no generation is over <size KB> (not checked with
+ * zip: rotation waits while the packer reads <path>.1); by time, all the
+ * lines of a file are of one period, but for its first line, which may
+ * have been stamped at the very end of the one before.
+ *
+ * Usage:  logtest5 <path> <count> <keep> <size KB|0> <zip 0|1>
+ *
+ * Verify with:  tests/check_logtest.py --rotate <path> <count> <keep> <size KB|0>
+ *
+ * Build as logtest4, and with -DWITH_ZLIB compress.c and -lz to try zip.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef AMIGA
+#include <unistd.h>
+#endif
+
+#include "sys.h"
+#include "readcfg.h"
+#include "common.h"
+#include "tools.h"
+#include "sem.h"
+
+/* What tools.c and branch.c take from the rest of the mailer */
+int inetd_flag = 0;
+#if defined(HAVE_THREADS) || defined(AMIGA)
+MUTEXSEM lsem, varsem;
+#endif
+
+char *mask_test (char *s, struct maskchain *chain)
+{
+  return NULL;                          /* no nolog */
+}
+
+#ifndef AMIGA
+int o_rename (const char *from, const char *to)
+{
+  return rename (from, to);
+}
+#endif
+
+#ifdef AMIGA
+#define TICK() amiga_msleep (10)
+#else
+#define TICK() usleep (10000)
+#endif
+
+#define PERIOD 2                        /* s, log-rotate-time of size 0 */
+
+int main (int argc, char **argv)
+{
+  char filler[45], first[MAXPATHLEN + 16];
+  int count, keep, size, zip, seq, i;
+  FILE *f;
+
+  if (argc < 6)
+  {
+    printf ("usage: logtest5 <path> <count> <keep> <size KB|0> <zip 0|1>\n");
+    return 20;
+  }
+  count = atoi (argv[2]);
+  keep  = atoi (argv[3]);
+  size  = atoi (argv[4]);
+  zip   = atoi (argv[5]);
+  if (count < 1 || keep < 1 || keep > 99 || size < 0)
+  {
+    printf ("count >= 1, keep 1-99, size >= 0\n");
+    return 20;
+  }
+#ifndef WITH_ZLIB
+  if (zip)
+  {
+    printf ("logtest5: built without zlib, zip 1 is ignored\n");
+    zip = 0;
+  }
+#endif
+
+  InitSem (&lsem);
+  InitSem (&varsem);
+  InitLog (2, -1, argv[1], NULL, NULL);
+  InitLogRotate (size, size ? 0 : PERIOD, keep, zip);
+
+  memset (filler, 'R', 44);
+  filler[44] = '\0';
+  for (seq = 0; seq < count; ++seq)
+  {
+    Log (2, "ROT seq=%06d %s", seq, filler);
+    if (size == 0)
+      for (i = 0; i < 25; ++i)
+        TICK ();
+  }
+  FlushLog ();
+
+  /* the packer of the last <path>.1 may still be at it */
+  snprintf (first, sizeof (first), "%s.1", argv[1]);
+  for (i = 0; zip && i < 1000 && (f = fopen (first, "r")) != NULL; ++i)
+  {
+    fclose (f);
+    TICK ();
+  }
+  printf ("logtest5: %d lines, keep %d, %s %d, zip %d\n", count, keep,
+          size ? "size KB" : "period s", size ? size : PERIOD, zip);
+  return 0;
+}
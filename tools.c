@@ -28,6 +28,7 @@
 #include "tools.h"
 #include "readdir.h"		       /* for [sys/]utime.h */
 #include "sem.h"
+#include "compress.h"
 #ifdef AMIGA
 #include "amiga/dosio.h"
 #endif
@@ -49,6 +50,18 @@ static int  current_loglevel = 1;
 static int  current_conlog   = 1;
 static char *current_logpath; /* This is malloc'ed string and can be NULL */
 static struct maskchain *current_nolog = NULL;
+/* loglevel-<subsystem>, and the highest level anything is done with
+ * for Log() and for each subsystem (see InitLog()) */
+static int  current_sublevel[LOG_NSUBSYS] = { 1, 1, 1, 1, 1 };
+static int  log_gate = 1;
+static int  log_subgate[LOG_NSUBSYS] = { 1, 1, 1, 1, 1 };
+
+#ifdef WITH_PERL
+/* on_log() may change the level, it has to see every line */
+#define LOG_DROP(lev, gate) 0
+#else
+#define LOG_DROP(lev, gate) ((lev) > (gate))
+#endif
 
 /*
  * Lowercase the string
@@ -273,8 +286,511 @@ struct tm *safe_localtime(time_t *t, struct tm *tm)
 #endif
 #endif
 
-void InitLog(int loglevel, int conlog, char *logpath, void *first)
+/*
+ * The log file is not written by whoever calls Log(). A line is copied
+ * to logq_in, which takes logqsem for a memcpy, and the caller goes
+ * back to its transfer. The queue is written out by the managers'
+ * loops (DrainLog()); a session writes it only when it has to: the
+ * queue is half full, its oldest line is LOG_QUEUE_AGE seconds old
+ * (the managers may sleep for a minute), the line is an error, or
+ * FlushLog() on exit. A writer takes one buffer out to the file, one
+ * open and one write, and gives the role up: what was logged meanwhile
+ * waits for the next one, so steady logging by the others cannot hold
+ * one session at the disk. A full buffer makes the caller wait rather
+ * than lose the line: losing lines has cost diagnostic evidence before
+ * (see log_write()).
+ *
+ * Fork builds have no manager in the session's process, so there a
+ * line is written when it is logged, as it always was.
+ */
+#define LOG_QUEUE_SIZE 8192
+#define LOG_QUEUE_HIGH (LOG_QUEUE_SIZE / 2)
+#define LOG_QUEUE_AGE  5               /* s */
+#define LOG_QUEUE_LEV  1               /* this and below are written at once */
+
+#if defined(HAVE_THREADS) || defined(AMIGA)
+static MUTEXSEM logqsem;
+#define LOG_DEFER
+#endif
+static int logq_ready;                 /* logqsem is set up (InitLog()) */
+static char logq_a[LOG_QUEUE_SIZE], logq_b[LOG_QUEUE_SIZE];
+static char *logq_in = logq_a, *logq_out = logq_b;
+static int logq_len, logq_writing;
+static time_t logq_since;              /* when logq_in got its first line */
+static time_t logq_turn;               /* log_next_turn (logq_since) */
+
+/*
+ * log-rotate, log-rotate-time, log-keep and log-compress. log_write()
+ * rotates under LOG_SEM before it appends: <log>.N is removed, every
+ * <log>.n becomes <log>.n+1 and <log> becomes <log>.1. Each append opens
+ * the log by name, so the next one starts a new file and no line can go
+ * to the old one -- renaming the log from outside could not promise
+ * that. Nothing in here may Log(), since it runs as the log writer;
+ * failures go to stderr, as for the append itself.
+ */
+#define LOG_ZEXT ".z"
+#define LOG_RETRY_ROTATE 600           /* s to wait after a failed rename */
+
+static boff_t rot_size;                /* bytes, 0 -- off */
+static int rot_period;                 /* seconds, 0 -- off */
+static int rot_keep = 1;
+static int rot_zip;
+static boff_t log_size = -1;           /* our count, -1 -- stat() the log */
+static time_t log_turn;                /* end of the log's period */
+static time_t log_hold;                /* no rotation before this */
+static int log_zipping;                /* <log>.1 is being compressed */
+
+void InitLogRotate (int size, int period, int keep, int zip)
+{
+  LockSem (LOG_SEM);
+  rot_size = (boff_t) size * 1024;
+  rot_period = period;
+  rot_keep = keep > 0 ? keep : 1;
+#ifdef WITH_ZLIB
+  rot_zip = zip;
+#endif
+  log_size = -1;
+  log_hold = 0;
+  ReleaseSem (LOG_SEM);
+}
+
+/* Where the rot_period holding t ends; periods start at local midnight */
+static time_t log_next_turn (time_t t)
+{
+  long off;
+
+  if (rot_period <= 0)
+    return 0;
+  off = tz_off (t, -1) * 60L;
+  return (time_t) (((t + off) / rot_period + 1) * rot_period - off);
+}
+
+#define LOG_DUE(len, now) (log_size > 0 && \
+  ((rot_size > 0 && log_size + (len) > rot_size) || \
+   (rot_period > 0 && (now) >= log_turn)))
+
+/*
+ * 1 if the log is to be rotated before len more bytes. Our count is
+ * checked with stat() before saying so: another process may have
+ * written or rotated the log meanwhile.
+ */
+static int log_rotate_due (char *path, int len, time_t now)
+{
+  struct stat sb;
+
+  if ((rot_size == 0 && rot_period == 0) || now < log_hold)
+    return 0;
+  if (log_size >= 0 && !LOG_DUE (len, now))
+    return 0;
+  if (stat (path, &sb) != 0)
+  {
+    log_size = 0;
+    log_turn = log_next_turn (now);
+    return 0;
+  }
+  /* Only another writer moves the turn: our own last batch may have
+   * gone out just after it (see log_put()) */
+  if (sb.st_size != log_size)
+    log_turn = log_next_turn (sb.st_mtime);
+  log_size = sb.st_size;
+  return LOG_DUE (len, now);
+}
+
+/*
+ * Shifts the generations and moves path to first ("<path>.1").
+ * 1 -- done, first is to be compressed.
+ */
+static int log_rotate (char *path, char *first, int size, time_t now)
+{
+  char from[MAXPATHLEN + 16];
+  int i, z;
+
+  if (log_zipping)
+    return 0;                          /* <log>.1 is still read: next time */
+  for (z = 0; z < 2; z++)
+  {
+    snprintf (from, sizeof (from), "%s.%d%s", path, rot_keep, z ? LOG_ZEXT : "");
+    UNLINK (from);
+  }
+  for (i = rot_keep - 1; i > 0; i--)
+    for (z = 0; z < 2; z++)
+    {
+      snprintf (from, sizeof (from), "%s.%d%s", path, i, z ? LOG_ZEXT : "");
+      snprintf (first, size, "%s.%d%s", path, i + 1, z ? LOG_ZEXT : "");
+      RENAME (from, first);
+    }
+  snprintf (first, size, "%s.1", path);
+  if (RENAME (path, first) != 0)
+  {
+    fprintf (stderr, "Cannot rename %s to %s: %s!\n", path, first, strerror (errno));
+    log_hold = now + LOG_RETRY_ROTATE;
+    log_size = -1;
+    return 0;
+  }
+  log_size = 0;
+  log_turn = log_next_turn (now);
+  log_zipping = rot_zip;
+  return rot_zip;
+}
+
+#ifdef WITH_ZLIB
+/*
+ * Compresses <log>.1 (arg, malloc'ed) to <log>.1.z. Written under
+ * another name first, so a half-done file is never taken for a
+ * generation.
+ */
+static void log_zip (void *arg)
+{
+  char *path = arg;
+  char tmp[MAXPATHLEN + 16], dst[MAXPATHLEN + 16];
+  char ibuf[ZBLKSIZE], obuf[ZBLKSIZE], *p;
+  FILE *in, *out = NULL;
+  void *z = NULL;
+  int rc = -1, n, ilen, olen, fin;
+
+  snprintf (dst, sizeof (dst), "%s" LOG_ZEXT, path);
+  snprintf (tmp, sizeof (tmp), "%s" LOG_ZEXT "t", path);
+#ifdef ZLIBDL
+  if (!zlib_loaded)
+    in = NULL;
+  else
+#endif
+  in = fopen (path, "rb");
+  if (in && (out = fopen (tmp, "wb")) != NULL && compress_init (1, 9, &z) == 0)
+  {
+    do
+    {
+      n = (int) fread (ibuf, 1, sizeof (ibuf), in);
+      fin = n < (int) sizeof (ibuf);
+      p = ibuf;
+      do
+      {
+        ilen = n;
+        olen = sizeof (obuf);
+        if ((rc = do_compress (1, obuf, &olen, p, &ilen, fin, z)) < 0 ||
+            (olen > 0 && fwrite (obuf, olen, 1, out) != 1))
+        {
+          rc = -1;
+          break;
+        }
+        p += ilen;
+        n -= ilen;
+      } while (n > 0 || (fin && rc == 0));
+    } while (!fin && rc >= 0);
+  }
+  if (z)
+    compress_deinit (1, z);
+  if (out && fclose (out) != 0)
+    rc = -1;
+  if (in)
+    fclose (in);
+  if (rc == 1 && RENAME (tmp, dst) == 0)
+    UNLINK (path);
+  else
+  {
+    UNLINK (tmp);
+    fprintf (stderr, "Cannot compress %s, left as it is!\n", path);
+  }
+  free (path);
+  LockSem (LOG_SEM);
+  log_zipping = 0;
+  ReleaseSem (LOG_SEM);
+}
+
+/* On its own thread where there are threads, else here and now */
+static void log_zip_start (char *first)
+{
+#ifdef HAVE_THREADS
+  if (branch (log_zip, first, strlen (first) + 1) < 0)
+#endif
+    log_zip (xstrdup (first));
+}
+#else
+#define log_zip_start(first) do { } while (0)
+#endif
+
+/*
+ * How much of data, in whole lines, still fits under log-rotate; at
+ * least one line into an empty log. Under LOG_SEM.
+ */
+static int log_fit (char *data, int len)
+{
+  char *p;
+  int n = 0, m;
+
+  if (rot_size == 0)
+    return len;
+  while (n < len)
+  {
+    p = memchr (data + n, '\n', len - n);
+    m = p ? (int) (p - data) + 1 : len;
+    if (log_size + m > rot_size && (n > 0 || log_size > 0))
+      break;
+    n = m;
+  }
+  return n;
+}
+
+/*
+ * Appends lines from data to the log, under LOG_SEM (which also keeps
+ * InitLog() from freeing the path under us). A batch of queued lines
+ * may span a rotation: the lines that fit go first, the rest into the
+ * new log. now is when the lines were logged, for log-rotate-time.
+ * Returns how much of len it has taken.
+ */
+static int log_write (char *data, int len, time_t now)
+{
+  static int first_time = 1;
+  char *using_logpath;
+  char first[MAXPATHLEN + 16];
+  int i, n, lead, zip = 0;
+
+  LockSem (LOG_SEM);
+  using_logpath = (current_logpath && *current_logpath) ?
+                               current_logpath : getenv(BINKD_LOGPATH_ENVIRON);
+  if (using_logpath == NULL)
+  {
+    ReleaseSem (LOG_SEM);
+    return len;
+  }
+  lead = first_time;
+  n = len;
+  if (log_rotate_due (using_logpath, len, now) &&
+      (rot_size == 0 || (rot_period > 0 && now >= log_turn) ||
+       (n = log_fit (data, len)) == 0))
+  {
+    zip = log_rotate (using_logpath, first, sizeof (first), now);
+    n = log_size == 0 ? log_fit (data, len) : len;
+  }
+  len = n;
+#ifdef AMIGA
+  /* Deliberately NOT fopen/fprintf/fclose -- see amiga/dosio.c.
+   *
+   * libnix hands out every descriptor from ___allocfd, which scans and
+   * realloc()s a shared global table with no locking anywhere in its
+   * file layer. Sessions here are separate Processes in ONE address
+   * space, so two opening files at the same moment can be handed the
+   * same slot and the loser's writes land in the winner's file. Log()
+   * was that layer's heaviest user by far -- one open and one close per
+   * line -- so routing it through dos.library directly removes it from
+   * the race entirely. Measured corruption before this: a .bsy holding
+   * a fragment of a log line, and tests/logtest3.c losing 92 of 1000
+   * lines while writing 4 lock markers into the log. */
+  {
+    int wrote = 0;
+
+    if (first_time)
+      amiga_dos_append (using_logpath, "\n", 1);
+    for (i = 0; i < 10; ++i)
+    {
+      if (i)
+        LOG_RETRY_DELAY ();
+      if (amiga_dos_append (using_logpath, data, len) == 0)
+      {
+        wrote = 1;
+        break;
+      }
+    }
+    if (wrote)
+      first_time = 0;
+    else
+      fprintf (stderr, "Cannot append to %s!\n", using_logpath);
+  }
+#else
+  {
+    FILE *logfile = 0;
+
+    /* pause between retries. Ten fopen()s back-to-back take microseconds,
+     * so a task holding the log for even a few ms makes every attempt fail
+     * and the message is dropped silently below -- which cost real
+     * diagnostic evidence on 2026-08-02. */
+    for (i = 0; logfile == 0 && i < 10; ++i)
+    {
+      if (i)
+        LOG_RETRY_DELAY ();
+      logfile = fopen (using_logpath, "a");
+    }
+    if (logfile)
+    {
+      if (first_time)
+        fputc ('\n', logfile);
+      fwrite (data, len, 1, logfile);
+      fclose (logfile);
+      first_time = 0;
+    }
+    else
+      fprintf (stderr, "Cannot open %s: %s!\n", using_logpath, strerror (errno));
+  }
+#endif
+  if (log_size >= 0)                   /* with the blank line of a start */
+    log_size += len + (lead && !first_time);
+  ReleaseSem (LOG_SEM);
+  if (zip)
+    log_zip_start (first);
+  return len;
+}
+
+static void log_write_all (char *data, int len, time_t now)
 {
+  int n;
+
+  while (len > 0 && (n = log_write (data, len, now)) > 0)
+  {
+    data += n;
+    len -= n;
+  }
+}
+
+/*
+ * The writer: takes one buffer out to the file and gives the role up.
+ * Only with logq_writing set by the caller.
+ */
+static void log_drain (void)
+{
+  char *t;
+  int len;
+  time_t when;
+
+  LockSem (&logqsem);
+  if ((len = logq_len) > 0)
+  {
+    t = logq_out;
+    logq_out = logq_in;
+    logq_in = t;
+    logq_len = 0;
+    when = logq_since;
+    ReleaseSem (&logqsem);
+    log_write_all (logq_out, len, when);
+    LockSem (&logqsem);
+  }
+  logq_writing = 0;
+  ReleaseSem (&logqsem);
+}
+
+static void log_put (char *line, int len, int lev)
+{
+  time_t now = time (NULL);
+  int writer, ended;
+
+  if (!logq_ready)                     /* Log() before the config is read */
+  {
+    log_write_all (line, len, now);
+    return;
+  }
+  for (;;)
+  {
+    LockSem (&logqsem);
+    /* log-rotate-time: what is queued goes out before the first line of
+     * the next period, so that no batch spans a turn */
+    ended = logq_len > 0 && logq_turn != 0 && now >= logq_turn;
+    if (!ended && logq_len + len <= LOG_QUEUE_SIZE)
+    {
+      if (logq_len == 0)
+      {
+        logq_since = now;
+        logq_turn = log_next_turn (now);
+      }
+      memcpy (logq_in + logq_len, line, len);
+      logq_len += len;
+      len = 0;
+    }
+    writer = !logq_writing;
+#ifdef LOG_DEFER
+    if (len == 0 && lev > LOG_QUEUE_LEV && logq_len < LOG_QUEUE_HIGH &&
+        now - logq_since < LOG_QUEUE_AGE)
+      writer = 0;                      /* left to the managers */
+#endif
+    if (writer)
+      logq_writing = 1;
+    ReleaseSem (&logqsem);
+    if (writer)
+      log_drain ();
+    if (len == 0)
+      return;
+    if (!writer)
+      LOG_RETRY_DELAY ();               /* full or ended, the writer is at it */
+  }
+}
+
+void DrainLog (void)
+{
+  int writer;
+
+  if (!logq_ready)
+    return;
+  LockSem (&logqsem);
+  if ((writer = (!logq_writing && logq_len > 0)) != 0)
+    logq_writing = 1;
+  ReleaseSem (&logqsem);
+  if (writer)
+    log_drain ();
+}
+
+void FlushLog (void)
+{
+  int writer, busy;
+
+  if (!logq_ready)
+    return;
+  for (;;)
+  {
+    LockSem (&logqsem);
+    if ((writer = (!logq_writing && logq_len > 0)) != 0)
+      logq_writing = 1;
+    busy = logq_writing || logq_len > 0;
+    ReleaseSem (&logqsem);
+    if (writer)
+      log_drain ();
+    else if (!busy)
+      return;
+    else
+      LOG_RETRY_DELAY ();
+  }
+}
+
+/*
+ * "DD Mon HH:MM:SS" of the current second into stamp (LOG_STAMP_LEN + 1
+ * bytes). safe_localtime() takes varsem and the fields were formatted
+ * again for every line, so the text is made once per second and copied
+ * out under logqsem after that.
+ */
+#define LOG_STAMP_LEN 15
+
+static time_t log_stamp_t = (time_t) -1;
+static char log_stamp_s[LOG_STAMP_LEN + 1];
+
+static void log_stamp (char *stamp)
+{
+  static const char *month[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                 "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+  time_t t = safe_time ();
+  int locked = logq_ready;             /* read once: InitLog() may set it */
+
+  if (locked)
+    LockSem (&logqsem);
+  if (t != log_stamp_t)
+  {
+    struct tm tm;
+
+    safe_localtime (&t, &tm);
+    snprintf (log_stamp_s, sizeof (log_stamp_s), "%02d %s %02d:%02d:%02d",
+              tm.tm_mday, month[tm.tm_mon], tm.tm_hour, tm.tm_min, tm.tm_sec);
+    log_stamp_t = t;
+  }
+  memcpy (stamp, log_stamp_s, sizeof (log_stamp_s));
+  if (locked)
+    ReleaseSem (&logqsem);
+}
+
+void InitLog(int loglevel, int conlog, char *logpath, void *first, int *sub)
+{
+  int i;
+
+  if (!logq_ready)                     /* the first call is made alone */
+  {
+    InitSem (&logqsem);
+    logq_ready = 1;
+  }
   LockSem(LOG_SEM);
   xfree(current_logpath);
   current_logpath  = NULL;   /* just in case if xstrdup() fails */
@@ -282,16 +798,22 @@ void InitLog(int loglevel, int conlog, char *logpath, void *first)
   current_conlog   = conlog;
   current_logpath  = xstrdup(logpath);
   current_nolog    = (struct maskchain *)first;
+  log_size         = -1;               /* the path may have changed */
+  log_gate = max (loglevel, conlog);
+  for (i = 0; i < LOG_NSUBSYS; i++)
+  {
+    current_sublevel[i] = (sub && sub[i] >= 0) ? sub[i] : loglevel;
+    log_subgate[i] = max (current_sublevel[i], conlog);
+  }
   ReleaseSem(LOG_SEM);
 }
 
-void vLog (int lev, char *s, va_list ap)
+/* sub: LOGS_xxx, -1 -- none */
+static void vLogS (int sub, int lev, char *s, va_list ap)
 {
-  static int first_time = 1;
-  static const char *month[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
-                                 "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
   char buf[1024];
   int ok = 1;
+  int level = sub < 0 ? current_loglevel : current_sublevel[sub];
 
   /* make string in buffer */
   vsnprintf(buf, sizeof(buf), s, ap);
@@ -306,12 +828,11 @@ void vLog (int lev, char *s, va_list ap)
   { /* if (ok) */
 
     char *using_logpath=NULL;
-    struct tm tm;
-    time_t t;
+    char stamp[LOG_STAMP_LEN + 1];
     static const char *marks = "!?+-";
     char ch = (0 <= lev && lev < (int) strlen (marks)) ? marks[lev] : ' ';
-    t = safe_time();
-    safe_localtime (&t, &tm);
+
+    log_stamp (stamp);
 
     if (lev <= current_conlog && !inetd_flag)
     {
@@ -320,8 +841,7 @@ void vLog (int lev, char *s, va_list ap)
        * FTN menu entry, so this lands on the sysop's screen -- having the
        * screen and the log read identically is worth the extra columns
        * the date and task id cost. */
-      fprintf (stderr, "%30.30s\r%c %02d %s %02d:%02d:%02d [%u] %s%s", " ", ch,
-           tm.tm_mday, month[tm.tm_mon], tm.tm_hour, tm.tm_min, tm.tm_sec,
+      fprintf (stderr, "%30.30s\r%c %s [%u] %s%s", " ", ch, stamp,
            (unsigned) PID (), buf, (lev >= 0) ? "\n" : "");
       fflush (stderr);
       ReleaseSem(LOG_SEM);
@@ -331,82 +851,18 @@ void vLog (int lev, char *s, va_list ap)
 
     using_logpath = (current_logpath && *current_logpath) ?
                                  current_logpath : getenv(BINKD_LOGPATH_ENVIRON);
-    if (lev <= current_loglevel && using_logpath)
+    if (lev <= level && using_logpath)
     {
-      int i;
-#ifdef AMIGA
-      /* Deliberately NOT fopen/fprintf/fclose -- see amiga/dosio.c.
-       *
-       * libnix hands out every descriptor from ___allocfd, which scans and
-       * realloc()s a shared global table with no locking anywhere in its
-       * file layer. Sessions here are separate Processes in ONE address
-       * space, so two opening files at the same moment can be handed the
-       * same slot and the loser's writes land in the winner's file. Log()
-       * was that layer's heaviest user by far -- one open and one close per
-       * line -- so routing it through dos.library directly removes it from
-       * the race entirely. Measured corruption before this: a .bsy holding
-       * a fragment of a log line, and tests/logtest3.c losing 92 of 1000
-       * lines while writing 4 lock markers into the log. */
-      {
-        char line[1100];
-        int len, wrote = 0;
-
-        len = snprintf (line, sizeof (line),
-                        "%s%c %02d %s %02d:%02d:%02d [%u] %s\n",
-                        first_time ? "\n" : "", ch,
-                        tm.tm_mday, month[tm.tm_mon], tm.tm_hour, tm.tm_min,
-                        tm.tm_sec, (unsigned) PID (), buf);
-        /* snprintf returns the length it WANTED on truncation */
-        if (len < 0)
-          len = 0;
-        else if (len > (int) sizeof (line) - 1)
-          len = (int) sizeof (line) - 1;
-
-        LockSem (LOG_SEM);
-        for (i = 0; i < 10 && len > 0; ++i)
-        {
-          if (i)
-            LOG_RETRY_DELAY ();
-          if (amiga_dos_append (using_logpath, line, len) == 0)
-          {
-            wrote = 1;
-            break;
-          }
-        }
-        if (wrote)
-          first_time = 0;
-        ReleaseSem (LOG_SEM);
-
-        if (!wrote && len > 0)
-          fprintf (stderr, "Cannot append to %s!\n", using_logpath);
-      }
-#else
-      FILE *logfile = 0;
-
-      LockSem(LOG_SEM);
-      /* pause between retries. Ten fopen()s back-to-back take microseconds,
-       * so a task holding the log for even a few ms makes every attempt fail
-       * and the message is dropped silently below -- which cost real
-       * diagnostic evidence on 2026-08-02. */
-      for (i = 0; logfile == 0 && i < 10; ++i)
-      {
-        if (i)
-          LOG_RETRY_DELAY ();
-        logfile = fopen (using_logpath, "a");
-      }
-      if (logfile)
-      {
-        fprintf (logfile, "%s%c %02d %s %02d:%02d:%02d [%u] %s\n",
-               first_time ? "\n" : "", ch,
-               tm.tm_mday, month[tm.tm_mon], tm.tm_hour, tm.tm_min, tm.tm_sec,
-               (unsigned) PID (), buf);
-        fclose (logfile);
-        first_time = 0;
-      }
-      else
-        fprintf (stderr, "Cannot open %s: %s!\n", using_logpath, strerror (errno));
-      ReleaseSem(LOG_SEM);
-#endif
+      char line[1100];
+      int len;
+
+      len = snprintf (line, sizeof (line), "%c %s [%u] %s\n", ch, stamp,
+                      (unsigned) PID (), buf);
+      /* snprintf returns the length it WANTED on truncation */
+      if (len > (int) sizeof (line) - 1)
+        len = (int) sizeof (line) - 1;
+      if (len > 0)
+        log_put (line, len, lev);
     }
 #ifdef WIN32
 #ifdef BINKD9X
@@ -418,7 +874,7 @@ void vLog (int lev, char *s, va_list ap)
 #endif
 
 #if defined (HAVE_VSYSLOG) && defined (HAVE_FACILITYNAMES)
-    if (lev <= current_loglevel && syslog_facility >= 0)
+    if (lev <= level && syslog_facility >= 0)
     {
       static int opened = 0;
       static int log_levels[] =
@@ -450,7 +906,10 @@ void vLog (int lev, char *s, va_list ap)
   } /* if (ok) */
 
   if (lev == 0)
+  {
+    FlushLog ();
     exit (1);
+  }
 
 #if defined(EMX) || defined(__WATCOMC__)
 /*
@@ -459,15 +918,42 @@ void vLog (int lev, char *s, va_list ap)
 #endif
 }
 
+void vLog (int lev, char *s, va_list ap)
+{
+  if (LOG_DROP (lev, log_gate))
+    return;
+  vLogS (-1, lev, s, ap);
+}
+
 void Log (int lev, char *s, ...)
 {
   va_list ap;
 
+  if (LOG_DROP (lev, log_gate))
+    return;
   va_start(ap, s);
-  vLog(lev, s, ap);
+  vLogS(-1, lev, s, ap);
   va_end(ap);
 }
 
+#define LOG_SUBSYS_FN(sub) \
+void Log_##sub (int lev, char *s, ...) \
+{ \
+  va_list ap; \
+ \
+  if (LOG_DROP (lev, log_subgate[LOGS_##sub])) \
+    return; \
+  va_start(ap, s); \
+  vLogS(LOGS_##sub, lev, s, ap); \
+  va_end(ap); \
+}
+
+LOG_SUBSYS_FN(protocol)
+LOG_SUBSYS_FN(queue)
+LOG_SUBSYS_FN(bsy)
+LOG_SUBSYS_FN(inbound)
+LOG_SUBSYS_FN(config)
+
 int o_memicmp (const void *s1, const void *s2, size_t n)
 {
   int i;
@@ -755,6 +1241,24 @@ int trunc_file (char *path)
   }
 }
 
+int set_file_size (char *path, boff_t size)
+{
+#if defined(AMIGA)
+  return amiga_dos_setsize (path, (long) size);
+#elif defined(UNIX)
+  int h, rc;
+
+  if ((h = open (path, O_WRONLY | O_CREAT, 0666)) == -1)
+    return -1;
+  rc = ftruncate (h, (off_t) size);
+  close (h);
+  return rc;
+#else
+  errno = EINVAL;
+  return -1;
+#endif
+}
+
 #ifndef UNIX
 /*
  * reliable remove a file (wait for lock), log this
@@ -779,6 +1283,170 @@ int sdelete (char *path)
 }
 #endif
 
+/*
+ * Deletes that could not be done when asked for. A file held open by
+ * somebody else for a moment (a viewer, a virus checker, another session
+ * finishing with the same lock) used to cost the caller sleep(1) per try;
+ * now it is queued here and delete_pending() retries it with a growing
+ * interval from the manager loops, while the session goes on.
+ *
+ * size and mtime are taken when the file is queued. If they have changed
+ * by the time of a retry, somebody has rewritten the file (a tosser
+ * appending to a bundle we have just sent) and it is not ours to remove.
+ */
+#define DELETE_RETRY_FIRST  2          /* seconds, doubled on every miss */
+#define DELETE_RETRY_MAX    300
+#define DELETE_RETRY_TRIES  10
+
+struct delete_entry
+{
+  struct delete_entry *next;
+  time_t due;
+  time_t mtime;
+  off_t size;
+  int tries;
+  int state;                           /* 1: being retried, 2: done */
+  char path[1];
+};
+
+static struct delete_entry *delete_queue;
+static int delete_running;
+
+static int delete_is_busy (int e)
+{
+  return e == EPERM || e == EACCES || e == EAGAIN || e == ETXTBSY;
+}
+
+int delete_defer (char *path)
+{
+  struct delete_entry *e, *p;
+  struct stat st;
+
+  if (stat (path, &st) != 0)
+    return errno == ENOENT ? 0 : -1;
+  e = xalloc (sizeof (*e) + strlen (path));
+  memset (e, 0, sizeof (*e));
+  strcpy (e->path, path);
+  e->mtime = st.st_mtime;
+  e->size = st.st_size;
+  e->due = time (NULL) + DELETE_RETRY_FIRST;
+  LockSem (&varsem);
+  for (p = delete_queue; p; p = p->next)
+    if (strcmp (p->path, path) == 0)
+      break;
+  if (p == NULL)
+  {
+    e->next = delete_queue;
+    delete_queue = e;
+  }
+  ReleaseSem (&varsem);
+  if (p)
+    free (e);
+  else
+    Log (4, "`%s' is in use, will remove it later", path);
+  return 0;
+}
+
+int delete_later (char *path)
+{
+  int rc, err;
+
+  if ((rc = UNLINK (path)) == 0)
+  {
+    Log (5, "unlinked `%s'", path);
+    return 0;
+  }
+  err = errno;                          /* delete_defer() stat()s */
+  if (delete_is_busy (err) && delete_defer (path) == 0)
+    rc = 0;
+  else
+    Log (1, "error unlinking `%s': %s", path, strerror (err));
+  return rc;
+}
+
+int delete_queued (char *path)
+{
+  struct delete_entry *p;
+
+  if (delete_queue == NULL)            /* the usual case, no lock needed */
+    return 0;
+  LockSem (&varsem);
+  for (p = delete_queue; p; p = p->next)
+    if (strcmp (p->path, path) == 0)
+      break;
+  ReleaseSem (&varsem);
+  return p != NULL;
+}
+
+void delete_pending (int all)
+{
+  struct delete_entry *e, **pe, *head;
+  struct stat st;
+  time_t now = time (NULL);
+  int claimed = 0;
+
+  if (delete_queue == NULL)
+    return;
+  /* One retrier at a time. Entries are only ever freed by it, and new
+   * ones are pushed at the head, so after the claim the list from head
+   * on can be walked without the lock while the unlinks run. */
+  LockSem (&varsem);
+  if (!delete_running)
+  {
+    delete_running = claimed = 1;
+    for (e = delete_queue; e; e = e->next)
+      if (all || e->due <= now)
+        e->state = 1;
+  }
+  head = delete_queue;
+  ReleaseSem (&varsem);
+  if (!claimed)
+    return;
+
+  for (e = head; e; e = e->next)
+  {
+    if (e->state != 1)
+      continue;
+    if (stat (e->path, &st) == 0 &&
+        (st.st_mtime != e->mtime || st.st_size != e->size))
+    {
+      Log (3, "`%s' has changed since, not removing it", e->path);
+      e->state = 2;
+    }
+    else if (UNLINK (e->path) == 0 || errno == ENOENT)
+    {
+      Log (5, "unlinked `%s'", e->path);
+      e->state = 2;
+    }
+    else if (!all && delete_is_busy (errno) && ++e->tries < DELETE_RETRY_TRIES)
+    {
+      int delay = DELETE_RETRY_FIRST << e->tries;
+
+      e->due = now + (delay > DELETE_RETRY_MAX ? DELETE_RETRY_MAX : delay);
+    }
+    else
+    {
+      Log (1, "error unlinking `%s': %s", e->path, strerror (errno));
+      e->state = 2;
+    }
+  }
+
+  LockSem (&varsem);
+  for (pe = &delete_queue; (e = *pe) != NULL;)
+  {
+    if (e->state == 2)
+    {
+      *pe = e->next;
+      free (e);
+      continue;
+    }
+    e->state = 0;
+    pe = &e->next;
+  }
+  delete_running = 0;
+  ReleaseSem (&varsem);
+}
+
 /*
  * Get the string with OS name/version
  */
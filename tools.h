@@ -36,7 +36,40 @@
 
 void vLog (int lev, char *s, va_list ap);
 void Log (int lev, char *s, ...);
-void InitLog(int loglevel, int conlog, char *logpath, void *first);
+/* sub: LOG_NSUBSYS levels for the file log, -1 -- loglevel (NULL: all) */
+void InitLog(int loglevel, int conlog, char *logpath, void *first, int *sub);
+/* log-rotate (KB), log-rotate-time (s), 0 -- off; log-keep; log-compress */
+void InitLogRotate (int size, int period, int keep, int zip);
+
+/*
+ * Subsystems with a loglevel of their own (loglevel-protocol etc.). A
+ * source file picks one with "#define LOG_SUBSYS protocol" before its
+ * #includes, and its Log() calls become Log_protocol(). A line above
+ * every level in force is dropped by a single compare, before any
+ * formatting.
+ */
+#define LOGS_protocol 0
+#define LOGS_queue    1
+#define LOGS_bsy      2
+#define LOGS_inbound  3
+#define LOGS_config   4
+#define LOG_NSUBSYS   5
+
+void Log_protocol (int lev, char *s, ...);
+void Log_queue (int lev, char *s, ...);
+void Log_bsy (int lev, char *s, ...);
+void Log_inbound (int lev, char *s, ...);
+void Log_config (int lev, char *s, ...);
+
+#ifdef LOG_SUBSYS
+#define LOG_FN_(sub) Log_##sub
+#define LOG_FN(sub) LOG_FN_(sub)
+#define Log LOG_FN(LOG_SUBSYS)
+#endif
+/* Writes out the log lines still queued (see tools.c), waits if needed */
+void FlushLog (void);
+/* The managers' part of it: one batch, if nobody is writing */
+void DrainLog (void);
 
 #define LOGINT(v) Log(6, "%s=%i\n", #v, (int)(v))
 
@@ -140,6 +173,13 @@ char *ed (char *src, char *a, char *b, size_t *size);
 int delete (char *);
 int trunc_file (char *);
 
+/*
+ * Makes path (created if missing) exactly size bytes long: AmigaOS
+ * SetFileSize(), ftruncate() on Unix (sparse there). 0 == ok; errno is
+ * not set on AmigaOS. Not supported elsewhere.
+ */
+int set_file_size (char *path, boff_t size);
+
 #ifdef UNIX
 #define sdelete(file) delete(file)
 #else
@@ -149,6 +189,20 @@ int trunc_file (char *);
 int sdelete (char *);
 #endif
 
+/*
+ * Remove a file; if it is in use just now, queue it for delete_pending()
+ * instead of waiting. 0 == removed or queued.
+ * delete_defer() only queues, delete_queued() tells if path is queued.
+ */
+int delete_later (char *);
+int delete_defer (char *);
+int delete_queued (char *);
+
+/*
+ * Retry queued deletes that are due (all: every one, once, for exit)
+ */
+void delete_pending (int all);
+
 /*
  * Get the string with OS name/version
  */